@@ -35,6 +35,8 @@
 #include <syslog.h>
 #include <math.h>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include <exception>
 #include <iostream>
 
@@ -49,20 +51,26 @@ static     MPI_Comm AdaptNodes;
 #endif /* UseMPI */
 
 #include "Adapt.h"
-#include "GaussMix.h"  // for gaussmix_pdf()
+#include "GaussMix.h"
+#include "SymmetricMatrix.h"
+#include "Kernels.h"
 
 using namespace std;
 
 #define DEBUG 0
 
+// number of data points whose posteriors are computed together (one triangular matrix multiply per cluster)
+#define POSTERIOR_BLOCK_SIZE 256
+
 /********************************************************************************************************
  *                         PRIVATE FUNCTION PROTOTYPES
  ********************************************************************************************************/
-int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<double> & norm_constants,
-        std::vector<Matrix *> &  expected_squares);
+template<typename T>
+int compute_expected_squares(const BasicMatrixView<T> & X,const Matrix & posteriors,const vector<double> & norm_constants,
+        std::vector<SymmetricMatrix> &  expected_squares);
 
 int compute_new_covariances(const Matrix & mu_matrix, const Matrix & nu_matrix, 
-        const vector<Matrix * > & sigma_matrix, const vector<double> & alphas,vector <Matrix *> & expected_squares, vector <Matrix *> & adapted_sigma_matrix);
+        const vector<Matrix * > & sigma_matrix, const vector<double> & alphas,const vector <SymmetricMatrix> & expected_squares, vector <Matrix *> & adapted_sigma_matrix);
 
 int compute_new_means(const Matrix & mu_matrix,const Matrix & weighted_means,const vector<double> & alphas,
                         Matrix & adapted_mu_matrix);
@@ -72,29 +80,38 @@ int compute_new_weights(const vector<double> & alphas,const vector<double> & nor
 
 int compute_norm_constants(const Matrix & posteriors,vector<double> & norm_constants);
 
-int compute_posteriors(Matrix & X, int n, int m, const Matrix & mu_matrix,
-        const vector<Matrix *> & sigma_matrix, const std::vector<double> & Pks, Matrix & posteriors);
+template<typename T>
+int compute_posteriors(const BasicMatrixView<T> & X, int num_points, const Matrix & mu_matrix,
+        const vector<Matrix *> & sigma_matrix, const std::vector<double> & Pks, gaussmix::CovarianceType covariance,
+        Matrix & posteriors);
 
-int compute_weighted_means(Matrix & X,const Matrix & posteriors,const vector<double> & norm_constants,
+template<typename T>
+int compute_weighted_means(const BasicMatrixView<T> & X,const Matrix & posteriors,const vector<double> & norm_constants,
         Matrix &  weighted_means);
 
+template<typename T>
+int adapt_data(const BasicMatrixView<T> & X, int n, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
+        Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks, gaussmix::CovarianceType covariance);
+
 /*************************************************************************************************************
  *                            PRIVATE FUNCTIONS
  **************************************************************************************************************/
 
 /*! \brief compute_expected_squares compute the squared-mean vectors weighted by the posteriors
  *
- * @param X n by m Matrix of data points
+ * @param X view of n by m data points
  * @param posteriors n by k matrix in which posterior densities will be placed, where k is the number of clusters
  * @param norm_constants the normalization constants (i-th constant is for i-th cluster)
- * @param[out] expected_squares vector of ptrs to mean-square matrices weighted by the posteriors (caller sets matrices to 0s)
+ * @param[out] expected_squares vector of (packed) mean-square matrices weighted by the posteriors (caller sets matrices to 0s)
  * @return 1 on success, 0 on error
  *
  *    note: the matrix we returned in the expected value (w.r.t norm constants) of a diagonal matrix
  *          whose i-th diagonal entry is given by the i-th component of the dot product of a data point with itself
  */
-int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<double> & norm_constants,
-        std::vector<Matrix *> &  expected_squares)
+template<typename T>
+int compute_expected_squares(const BasicMatrixView<T> & X,const Matrix & posteriors,const vector<double> & norm_constants,
+        std::vector<SymmetricMatrix> &  expected_squares)
 {
     int retcode = 0;
 
@@ -102,7 +119,7 @@ int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<d
     {
         int num_clusters = norm_constants.size();
         int num_points = posteriors.rowCount();
-        int num_dimensions = expected_squares[0]->colCount();
+        int num_dimensions = expected_squares[0].dimension();
 
         // for each cluster
 #ifdef _OPENMP
@@ -110,7 +127,7 @@ int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<d
 #endif /* _OPENMP */
         for (int k = 0; k < num_clusters; k++)
         {
-            Matrix * pm = expected_squares[k];
+            SymmetricMatrix * pm = &expected_squares[k];
 
             // for each data point
             for (int n = 0; n < num_points; n++)
@@ -133,21 +150,12 @@ int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<d
 #ifdef UseMPI
         for (int k=0; k<num_clusters; k++)
         {
-            // Reduce each matrix
-            double dim0,dim1;
-            double *mat;
-            int serialSize = num_clusters*num_clusters+2;
-            double global_mat[serialSize];
-            
-            mat = expected_squares[k]->Serialize();
-            // Save dimensions
-            dim0 = mat[0];
-            dim1 = mat[1];
-            MPI_Allreduce(mat, global_mat, serialSize, MPI_DOUBLE, MPI_SUM, AdaptNodes);
-            // Restore dimensions after summation
-            global_mat[0] = dim0;
-            global_mat[1] = dim1;
-            expected_squares[k]->deSerialize(global_mat);
+            // Reduce each (packed) matrix
+            int packedSize = expected_squares[k].packedSize();
+            double global_mat[packedSize];
+
+            MPI_Allreduce(expected_squares[k].getArray(), global_mat, packedSize, MPI_DOUBLE, MPI_SUM, AdaptNodes);
+            memcpy(expected_squares[k].getArray(), global_mat, packedSize*sizeof(double));
         }
 #endif /* UseMPI */
         retcode = 1;
@@ -170,13 +178,13 @@ int compute_expected_squares(Matrix & X,const Matrix & posteriors,const vector<d
  * @param nu_matrix matrix of adapated cluster means
  * @param sigma_matrix vector of (ptrs to) old covariance matrices
  * @param alphas the alpha constants used for weight computations
- * @param expected_squares the expected square means returned from compute_expected_squares
+ * @param expected_squares the (packed) expected square means returned from compute_expected_squares
  * @param[out] adapted_sigma_matrix (ptrs to) the new covariance matrices (caller inits to 0)
  * @return 1 on success, 0 on error
  */
 int compute_new_covariances(const Matrix & mu_matrix, const Matrix & nu_matrix, 
     const vector<Matrix * > & sigma_matrix, const vector<double> & alphas,
-    vector <Matrix *> & expected_squares, vector <Matrix *> & adapted_sigma_matrix)
+    const vector <SymmetricMatrix> & expected_squares, vector <Matrix *> & adapted_sigma_matrix)
 {
     int retcode = 0;
 
@@ -187,7 +195,8 @@ int compute_new_covariances(const Matrix & mu_matrix, const Matrix & nu_matrix,
          *  now compute the new covariances C_i as a_i * E_i + (1 - a_i) * ( c_i + diag(m_i) ) - diag(m_i)
          *  where mi_is the old mean, c_i s the old covariance, diag(m_i) is the diagonal matrix w/entry (j,j)
          *  given by the square of the j-th component of m_i, and E_i is the "expected squares" matrix taken
-         *  w.r.t the subpop to which we're adapting the model.
+         *  w.r.t the subpop to which we're adapting the model. Everything is symmetric, so only the upper
+         *  triangle is computed.
          */
         int num_clusters = adapted_sigma_matrix.size();
         int num_dimensions = mu_matrix.colCount();
@@ -198,11 +207,12 @@ int compute_new_covariances(const Matrix & mu_matrix, const Matrix & nu_matrix,
 #endif /* _OPENMP */
         for (int k = 0; k < num_clusters; k++)
         {
-            for (int i = 0; i < num_dimensions; i++)
+            SymmetricMatrix adapted(num_dimensions);
+            for (int j = 0; j < num_dimensions; j++)
             {
-                for (int j = 0; j < num_dimensions; j++)
+                for (int i = 0; i <= j; i++)
                 {
-                    double new_val = alphas[k] * expected_squares[k]->getValue(i,j);
+                    double new_val = alphas[k] * expected_squares[k].getValue(i,j);
                     double old_val = sigma_matrix[k]->getValue(i,j);
                     if (i == j)
                     {
@@ -215,10 +225,11 @@ int compute_new_covariances(const Matrix & mu_matrix, const Matrix & nu_matrix,
                         double temp = nu_matrix.getValue(k,j);
                         old_val -= temp*temp;
                     }
-                    adapted_sigma_matrix[k]->update(new_val + old_val,i,j);
+                    adapted.update(new_val + old_val,i,j);
                 }
 
             }
+            adapted.copyTo(*adapted_sigma_matrix[k]);
         }
         retcode = 1;
     }
@@ -309,7 +320,7 @@ int compute_new_weights(const vector<double> & alphas,const vector<double> & nor
 
         // for each cluster
 #ifdef _OPENMP
-        # pragma omp parallel for
+        # pragma omp parallel for reduction(+:sum_weights)
 #endif /* _OPENMP */
         for (int k = 0; k < num_clusters; k++)
         {
@@ -394,16 +405,18 @@ int compute_norm_constants(const Matrix & posteriors,vector<double> & norm_const
 
 /*! \brief computer_posteriors compute the poster densities for each data point for each cluster
  *
- * @param X n by m Matrix of data points
+ * @param X view of n by m data points
  * @param num_points the number of data points
  * @param mu_matrix matrix of cluster means returned from EM call (EM_Algorithm.h)
  * @param sigma_matrix vector of pointers to covariances matrices returned from EM call
  * @param Pks cluster weights returned from EM call
+ * @param covariance structure of the covariances, which picks the density kernel
  * @param[out] posteriors n by k matrix in which posterior densities will be placed, where k is the number of clusters
  * @return 1 on success, 0 on error
  */
-int compute_posteriors(Matrix & X, int num_points, Matrix & mu_matrix, vector<Matrix *> & sigma_matrix,
-                        std::vector<double> & Pks, Matrix & posteriors)
+template<typename T>
+int compute_posteriors(const BasicMatrixView<T> & X, int num_points, const Matrix & mu_matrix, const vector<Matrix *> & sigma_matrix,
+                        const std::vector<double> & Pks, gaussmix::CovarianceType covariance, Matrix & posteriors)
 {
     int retcode = 0;
     int num_clusters = mu_matrix.rowCount();
@@ -412,56 +425,51 @@ int compute_posteriors(Matrix & X, int num_points, Matrix & mu_matrix, vector<Ma
     if (DEBUG) cout << "num_clusters: "<<num_clusters<<", num_dimensions: "<<num_dimensions<<", num_points: "<<num_points<<endl;
     try
     {
-        // for each cluster
+        // factor every covariance (or get the inverse variances) once, rather than once per data point
+        gaussmix::MixtureScorer scorer(covariance, sigma_matrix, mu_matrix, Pks);
+
+        // posteriors is column-major, one column per cluster
+        double * post = posteriors.getArray();
+        int ld = posteriors.rowCount();
+
+        // for each block of data points
+        int num_blocks = (num_points + POSTERIOR_BLOCK_SIZE - 1)/POSTERIOR_BLOCK_SIZE;
 #ifdef _OPENMP
-        # pragma omp parallel for
+        # pragma omp parallel
 #endif /* _OPENMP */
-        for (int k = 0; k < num_clusters; k++)
         {
+            vector<double> points((std::size_t)POSTERIOR_BLOCK_SIZE*num_dimensions);
+            vector<double> work((std::size_t)POSTERIOR_BLOCK_SIZE*num_dimensions);
+            vector<double> distances(POSTERIOR_BLOCK_SIZE);
+            vector<double> z((std::size_t)POSTERIOR_BLOCK_SIZE*num_clusters);
 
-            // for each data point
-            for (int n = 0; n < num_points; n++)
+#ifdef _OPENMP
+            # pragma omp for schedule(static)
+#endif /* _OPENMP */
+            for (int block = 0; block < num_blocks; block++)
             {
+                int first = block*POSTERIOR_BLOCK_SIZE;
+                int count = std::min(POSTERIOR_BLOCK_SIZE, num_points - first);
+                X.copyRowBlock(first, count, &points[0], count);
 
-                // get the log likelihood density for the point
-                vector<double> mean_vec;
-                mu_matrix.getCopyOfRow(k,mean_vec);
+                // get the log of the weighted likelihood density of every point in the block under every cluster
+                scorer.logWeightedDensities(count, &points[0], &work[0], &distances[0], &z[0]);
 
-                std::vector<double> temp;
-                double lld = gaussmix::gaussmix_pdf(num_dimensions,X.getCopyOfRow(n,temp),
-                                    *(sigma_matrix[k]),mean_vec);
-
-                // compute the weighted likelihood density (un-log'd)
-                double post_prob = exp(lld)*Pks[k];
-                posteriors.update(post_prob,n,k);
-                if (DEBUG)
+                // now normalize each data point's posteriors by their sum over the clusters
+                for (int i = 0; i < count; i++)
                 {
-                    cout << "Printing posteriors in compute_posteriors"<<endl;
-                    posteriors.print();
+                    double * z_i = &z[(std::size_t)i*num_clusters];
+                    logNormalize(num_clusters, z_i);
+                    for (int k = 0; k < num_clusters; k++)
+                        post[(std::size_t)k*ld + first + i] = exp(z_i[k]);
                 }
-
             }
         }
 
-        // now for each data point
-        for (int n = 0; n < num_points; n++)
+        if (DEBUG)
         {
-            double temp_sum = 0.0;
-
-            // sum the densities for the data point, over the clusters
-            for (int k = 0; k < num_clusters; k++)
-            {
-                temp_sum += posteriors.getValue(n,k);
-            }
-
-            // now normalize the data point posteriors by the sum
-
-            // sum the densities for the data point, over the clusters
-            for (int k = 0; k < num_clusters; k++)
-            {
-                posteriors.update(posteriors.getValue(n,k)/temp_sum,n,k);
-            }
-
+            cout << "Printing posteriors in compute_posteriors"<<endl;
+            posteriors.print();
         }
         retcode = 1;
     }
@@ -483,14 +491,15 @@ int compute_posteriors(Matrix & X, int num_points, Matrix & mu_matrix, vector<Ma
 
 /*! \brief compute_weighted_means compute the mean vectors weighted by the posteriors
  *
- * @param X n by m matrix of data points (n is number of data points, m is dimensionality)
+ * @param X view of n by m data points (n is number of data points, m is dimensionality)
  * @param posteriors n by k matrix in which posterior densities will be placed, where k is the number of clusters
  * @param norm_constants the normalization constants (i-th constant is for i-th cluster)
  * @param[out] weighted_means the mean vectors weighted by the posteriors (caller inits to 0s matrix of right size)
  * @return 1 on success, 0 on error
  *
  */
-int compute_weighted_means(Matrix & X,const Matrix & posteriors,const vector<double> & norm_constants,
+template<typename T>
+int compute_weighted_means(const BasicMatrixView<T> & X,const Matrix & posteriors,const vector<double> & norm_constants,
         Matrix &  weighted_means)
 {
     int retcode = 0;
@@ -513,15 +522,11 @@ int compute_weighted_means(Matrix & X,const Matrix & posteriors,const vector<dou
             {
                 temp_vec[m] = 0.0; // initialize
             }
-            // for each data point
+            double scratch[num_dimensions];
+            // for each data point, add in its coordinates to the running sum
             for (int n = 0; n < num_points; n++)
             {
-                // for each dimension
-                for (int m = 0; m < num_dimensions; m++ )
-                {
-                    // add in coordinate to running sum
-                    temp_vec[m] +=  X.getValue(n,m)*posteriors.getValue(n,k);
-                }
+                weightedAccumulate(num_dimensions, posteriors.getValue(n,k), X.row(n, scratch), temp_vec);
             }
             // now normalize
             for (int m  = 0; m < num_dimensions; m++)
@@ -575,11 +580,35 @@ int compute_weighted_means(Matrix & X,const Matrix & posteriors,const vector<dou
  ******************************************************************/
 
 
-int gaussmix::adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
-            Matrix &mu_matrix, std::vector<double> &Pks,
+int gaussmix::adapt(const MatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+            const Matrix &mu_matrix, const std::vector<double> &Pks,
+            vector<Matrix*> &adapted_sigma_matrix,
+            Matrix &adapted_mu_matrix,
+            std::vector<double> &adapted_Pks,
+            CovarianceType covariance)
+{
+    return adapt_data(X,n,sigma_matrix,mu_matrix,Pks,adapted_sigma_matrix,adapted_mu_matrix,adapted_Pks,covariance);
+}
+
+int gaussmix::adapt(const FloatMatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+            const Matrix &mu_matrix, const std::vector<double> &Pks,
             vector<Matrix*> &adapted_sigma_matrix,
             Matrix &adapted_mu_matrix,
-            std::vector<double> &adapted_Pks)
+            std::vector<double> &adapted_Pks,
+            CovarianceType covariance)
+{
+    return adapt_data(X,n,sigma_matrix,mu_matrix,Pks,adapted_sigma_matrix,adapted_mu_matrix,adapted_Pks,covariance);
+}
+
+/*! \brief body of the public adapt routines, for double or float data
+*/
+template<typename T>
+int adapt_data(const BasicMatrixView<T> & X, int n, const vector<Matrix*> &sigma_matrix,
+            const Matrix &mu_matrix, const std::vector<double> &Pks,
+            vector<Matrix*> &adapted_sigma_matrix,
+            Matrix &adapted_mu_matrix,
+            std::vector<double> &adapted_Pks,
+            gaussmix::CovarianceType covariance)
 {
     int num_clusters = mu_matrix.rowCount();        // number of gaussians in mix
     int num_dimensions = mu_matrix.colCount();        // number of data dimensions
@@ -606,7 +635,7 @@ int gaussmix::adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
          */
         Matrix posteriors(n,Pks.size());
         if (DEBUG) cout << "Calculating posteriors on node "<<myNode<<endl;
-        retcode = compute_posteriors(X,n,mu_matrix,sigma_matrix,Pks,posteriors);
+        retcode = compute_posteriors(X,n,mu_matrix,sigma_matrix,Pks,covariance,posteriors);
 
         if (DEBUG)
         {
@@ -676,13 +705,10 @@ int gaussmix::adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
          *  matrix, and the expectation has normalizing constant v_i.
          *
          */
-        vector<Matrix * > expected_squares;
+        vector<SymmetricMatrix> expected_squares;
         if (retcode != 0)
         {
-            for (int i = 0; i < num_clusters; i++)
-            {
-                expected_squares.push_back(new Matrix(num_dimensions,num_dimensions));
-            }
+            expected_squares.assign(num_clusters, SymmetricMatrix(num_dimensions));
 
             retcode = compute_expected_squares(X,posteriors,norm_constants,expected_squares);
 
@@ -691,7 +717,11 @@ int gaussmix::adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
         {
             cout << "Computed expected squares:";
             for (int i=0; i<num_clusters; i++)
-                expected_squares[i]->print();
+            {
+                Matrix full(num_dimensions,num_dimensions);
+                expected_squares[i].copyTo(full);
+                full.print();
+            }
         }
 
         /*
@@ -729,18 +759,21 @@ int gaussmix::adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
             retcode = compute_new_covariances(mu_matrix,adapted_mu_matrix, sigma_matrix,alphas,expected_squares,adapted_sigma_matrix);
         }
 
-        if (expected_squares.size() > 0)
-        {
-            for (int i = 0; i < num_clusters; i++)
-            {
-                delete expected_squares[i];
-            }
-        }
         if (DEBUG)
         {
             cout << "Computed new covariances" << endl;
         }
 
+        /*
+         *  9. off the diagonal, C_i is just the old covariance scaled by (1 - a_i), so diagonal models stay
+         *  diagonal; spherical and tied ones are put back in shape: a spherical C_i gets the mean of its
+         *  diagonal, and tied ones are replaced by their average weighted by the new cluster weights.
+         */
+        if (retcode != 0)
+        {
+            gaussmix::constrainCovariances(covariance,adapted_sigma_matrix,adapted_Pks);
+        }
+
     }
 #ifdef UseMPI
     // Distribute results to nodes where n == 0
@@ -38,6 +38,8 @@
 #include <vector>
 
 #include "Matrix.h"
+#include "MatrixView.h"
+#include "CovarianceModel.h"
 
 
 namespace gaussmix
@@ -47,7 +49,7 @@ namespace gaussmix
 /*! \brief adapt: adapt a Gaussian Mixture model to a given sub-population.
 *
 *
-@param[in] X subpopulation data (dimensionality = sigma_matrix.num_cols)
+@param[in] X view of subpopulation data (dimensionality = sigma_matrix.num_cols)
 @param[in] n number of data points in sub-pop
 @param[in] sigma_matrix vector of covariance matrices from EM call
 @param [in] mu_matrix cluster means returned from EM call
@@ -55,11 +57,19 @@ namespace gaussmix
 @param[out] adapted_sigma_matrix vector of covariance matrices
 @param [out] adapted_mu_matrix cluster means
 @param [out] adapted_Pks cluster weights
+@param [in] covariance structure of the model's covariances (posteriors are computed with the matching kernel,
+            and the adapted covariances are projected back onto the structure)
 @return 1 on success, 0 on error
 */
-int adapt(Matrix & X, int n, std::vector<Matrix*> &sigma_matrix,
-		Matrix &mu_matrix, std::vector<double> & Pks, std::vector<Matrix*> &adapted_sigma_matrix,
-		Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks);
+int adapt(const MatrixView & X, int n, const std::vector<Matrix*> &sigma_matrix,
+		const Matrix &mu_matrix, const std::vector<double> & Pks, std::vector<Matrix*> &adapted_sigma_matrix,
+		Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks, CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief adapt: as above, for a sub-population held as float32 data (statistics are still accumulated in double)
+*/
+int adapt(const FloatMatrixView & X, int n, const std::vector<Matrix*> &sigma_matrix,
+		const Matrix &mu_matrix, const std::vector<double> & Pks, std::vector<Matrix*> &adapted_sigma_matrix,
+		Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks, CovarianceType covariance = COVARIANCE_FULL);
 
 
 #endif /* ADAPT_H_ */
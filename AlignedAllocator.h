@@ -0,0 +1,110 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+
+/*! \file AlignedAllocator.h
+*   \brief Aligned allocation and SIMD padding helpers for data and parameter arrays
+*/
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+
+/*! \brief byte alignment of matrix, data and parameter storage (one cache line, and a full avx-512 register) */
+#define GAUSSMIX_ALIGNMENT 64
+
+/*! \brief number of doubles in one GAUSSMIX_ALIGNMENT-sized block (the widest SIMD register we pad for) */
+const int SIMD_DOUBLES = GAUSSMIX_ALIGNMENT / sizeof(double);
+
+
+/*! \brief round a row (or column) length up to a whole number of SIMD registers
+*
+* Laying rows out with this leading dimension in GAUSSMIX_ALIGNMENT-aligned storage makes every row
+* start on an aligned boundary, and lets kernels use full-width loads with no remainder handling.
+* The padding entries are kept at zero.
+@param m row length
+@return the padded leading dimension (>= m)
+*/
+constexpr int paddedLeadingDimension(int m)
+{
+	return (m + SIMD_DOUBLES - 1) / SIMD_DOUBLES * SIMD_DOUBLES;
+}
+
+
+/*! \brief standard allocator returning GAUSSMIX_ALIGNMENT-aligned memory, for use with std::vector */
+template<typename T>
+class AlignedAllocator
+{
+	public:
+	typedef T value_type;
+
+	AlignedAllocator() {}
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U> &) {}
+
+	/** allocate aligned storage for count objects
+	@param count number of objects
+	@return the storage
+	@throw std::bad_alloc on failure*/
+	T * allocate(std::size_t count)
+	{
+		if (count == 0)
+			return 0;
+		void * mem = 0;
+		if (posix_memalign(&mem, GAUSSMIX_ALIGNMENT, count*sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T *>(mem);
+	}
+
+	/** release storage obtained from allocate()
+	@param p the storage*/
+	void deallocate(T * p, std::size_t)
+	{
+		free(p);
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U> &) const { return true; }
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+
+/*! \brief std::vector whose data() is GAUSSMIX_ALIGNMENT-aligned */
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+#endif /* ALIGNED_ALLOCATOR_H */
@@ -0,0 +1,259 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file CovarianceModel.cpp
+*   \brief implementations for the covariance structures and the block scorer
+*/
+
+#include <math.h>
+#include <vector>
+#include <cblas.h>
+
+#include "CovarianceModel.h"
+
+using namespace std;
+
+/********************************************************************************************************
+ *                         PRIVATE FUNCTION PROTOTYPES
+ ********************************************************************************************************/
+
+std::vector<Matrix*> factored_covariances(gaussmix::CovarianceType type, const std::vector<Matrix*> & sigma_matrix);
+
+/*******************************************************************************************
+ *                         IMPLEMENTATIONS
+ ******************************************************************************************/
+
+/**
+\brief the covariances a scorer has to factor: all of them (full), the shared one (tied) or none
+@param type structure of the covariances
+@param sigma_matrix the k covariances
+@return the matrices to factor
+*/
+std::vector<Matrix*> factored_covariances(gaussmix::CovarianceType type, const std::vector<Matrix*> & sigma_matrix)
+{
+    if (type == gaussmix::COVARIANCE_FULL)
+        return sigma_matrix;
+    if (type == gaussmix::COVARIANCE_TIED && !sigma_matrix.empty())
+        return std::vector<Matrix*>(1, sigma_matrix[0]);
+    return std::vector<Matrix*>();
+}
+
+/**
+\brief project covariances onto a structure
+@param type structure to impose
+@param sigma_matrix the k covariances, changed in place
+@param weights k weights for the tied average
+*/
+void gaussmix::constrainCovariances(CovarianceType type, std::vector<Matrix*> & sigma_matrix, const std::vector<double> & weights)
+{
+    int k = sigma_matrix.size();
+    if (k == 0)
+        return;
+    int m = sigma_matrix[0]->rowCount();
+
+    switch (type)
+    {
+    case COVARIANCE_DIAGONAL:
+        for (int g = 0; g < k; g++)
+            for (int j = 0; j < m; j++)
+                for (int i = 0; i < m; i++)
+                    if (i != j)
+                        sigma_matrix[g]->update(0.0, i, j);
+        break;
+
+    case COVARIANCE_SPHERICAL:
+        for (int g = 0; g < k; g++)
+        {
+            double variance = 0.0;
+            for (int j = 0; j < m; j++)
+                variance += sigma_matrix[g]->getValue(j, j);
+            variance /= m;
+            for (int j = 0; j < m; j++)
+                for (int i = 0; i < m; i++)
+                    sigma_matrix[g]->update((i == j) ? variance : 0.0, i, j);
+        }
+        break;
+
+    case COVARIANCE_TIED:
+        {
+            double total = 0.0;
+            for (int g = 0; g < k; g++)
+                total += weights[g];
+            for (int j = 0; j < m; j++)
+                for (int i = 0; i < m; i++)
+                {
+                    double pooled = 0.0;
+                    for (int g = 0; g < k; g++)
+                        pooled += weights[g]*sigma_matrix[g]->getValue(i, j);
+                    pooled /= total;
+                    for (int g = 0; g < k; g++)
+                        sigma_matrix[g]->update(pooled, i, j);
+                }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+\brief prepare a mixture for scoring blocks of points
+@param type structure of the covariances
+@param sigma_matrix the k covariances
+@param mu_matrix k x m means
+@param Pks k cluster weights
+*/
+gaussmix::MixtureScorer::MixtureScorer(CovarianceType type, const std::vector<Matrix*> & sigma_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks) throw (SizeError, LapackError)
+    : type(type), k(Pks.size()), m(mu_matrix.colCount()), factors(factored_covariances(type, sigma_matrix))
+{
+    int covariances = (type == COVARIANCE_TIED) ? 1 : k;
+    if (mu_matrix.rowCount() < k || (int)sigma_matrix.size() < covariances)
+        throw SizeError((char *)"Error: a mixture needs a mean and a covariance for every cluster");
+    for (int g = 0; g < covariances; g++)
+        if (sigma_matrix[g]->rowCount() != m || sigma_matrix[g]->colCount() != m)
+            throw SizeError((char *)"Error: covariance and mean dimensions of a mixture do not agree");
+
+    means.resize((std::size_t)k*m);
+    for (int g = 0; g < k; g++)
+        for (int dim = 0; dim < m; dim++)
+            means[(std::size_t)g*m + dim] = mu_matrix.getValue(g, dim);
+
+    logWeights.resize(k);
+    switch (type)
+    {
+    case COVARIANCE_FULL:
+        for (int g = 0; g < k; g++)
+            logWeights[g] = log(Pks[g]) + factors.logNormalizers()[g];
+        break;
+
+    case COVARIANCE_TIED:
+        // score against inv(L)*mu, so each block is whitened once for all the components
+        for (int g = 0; g < k; g++)
+        {
+            if (m > 0)
+                cblas_dtrmv(CblasColMajor, CblasLower, CblasNoTrans, CblasNonUnit, m, factors.whitener(0),
+                        factors.leadingDimension(), &means[(std::size_t)g*m], 1);
+            logWeights[g] = log(Pks[g]) + factors.logNormalizers()[0];
+        }
+        break;
+
+    case COVARIANCE_DIAGONAL:
+    case COVARIANCE_SPHERICAL:
+        // the spherical variance is the mean of the diagonal, so a diagonal matrix is scored as its closest multiple of I
+        precisions.resize((type == COVARIANCE_DIAGONAL) ? (std::size_t)k*m : k);
+        for (int g = 0; g < k; g++)
+        {
+            double logdet = 0.0;
+            double mean_variance = 0.0;
+            for (int dim = 0; dim < m; dim++)
+            {
+                double variance = sigma_matrix[g]->getValue(dim, dim);
+                if (!(variance > 0.0))
+                    throw LapackError("Error in MixtureScorer--covariance is not positive definite");
+                if (type == COVARIANCE_DIAGONAL)
+                {
+                    precisions[(std::size_t)g*m + dim] = 1.0/variance;
+                    logdet += log(variance);
+                }
+                mean_variance += variance;
+            }
+            if (type == COVARIANCE_SPHERICAL)
+            {
+                mean_variance /= m;
+                precisions[g] = 1.0/mean_variance;
+                logdet = m*log(mean_variance);
+            }
+            logWeights[g] = log(Pks[g]) - 0.5*( m*log(2.0*M_PI) + logdet );
+        }
+        break;
+    }
+}
+
+/**
+\brief weighted log densities of a block of points under every component
+@param count number of points
+@param X count x m column-major block of points
+@param work count*m scratch
+@param distances count scratch
+@param z output, count rows of k
+*/
+void gaussmix::MixtureScorer::logWeightedDensities(int count, const double X[], double work[], double distances[],
+        double z[]) const
+{
+    if (type == COVARIANCE_TIED && count > 0 && m > 0)
+    {
+        // whiten the block once: each row x' becomes (inv(L)*x)'
+        for (std::size_t i = 0; i < (std::size_t)count*m; i++)
+            work[i] = X[i];
+        cblas_dtrmm(CblasColMajor, CblasRight, CblasLower, CblasTrans, CblasNonUnit, count, m, 1.0,
+                factors.whitener(0), factors.leadingDimension(), work, count);
+    }
+
+    for (int g = 0; g < k; g++)
+    {
+        const double *mu = &means[(std::size_t)g*m];
+        switch (type)
+        {
+        case COVARIANCE_FULL:
+            factors.mahalanobisBlock(g, count, X, count, mu, work, distances);
+            break;
+
+        case COVARIANCE_TIED:
+        case COVARIANCE_DIAGONAL:
+        case COVARIANCE_SPHERICAL:
+            {
+                // the tied distances are plain euclidean ones between whitened points and means
+                const double *points = (type == COVARIANCE_TIED) ? work : X;
+                for (int i = 0; i < count; i++)
+                    distances[i] = 0.0;
+                for (int dim = 0; dim < m; dim++)
+                {
+                    const double *x = points + (std::size_t)dim*count;
+                    double mu_dim = mu[dim];
+                    double precision = (type == COVARIANCE_DIAGONAL) ? precisions[(std::size_t)g*m + dim] : 1.0;
+                    for (int i = 0; i < count; i++)
+                    {
+                        double diff = x[i] - mu_dim;
+                        distances[i] += precision*diff*diff;
+                    }
+                }
+                if (type == COVARIANCE_SPHERICAL)
+                    for (int i = 0; i < count; i++)
+                        distances[i] *= precisions[g];
+            }
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+            z[(std::size_t)i*k + g] = logWeights[g] - 0.5*distances[i];
+    }
+}
@@ -0,0 +1,118 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file CovarianceModel.h
+*   \brief covariance structures a mixture can be fit with, and scoring of blocks of points under each
+*/
+
+#ifndef COVARIANCE_MODEL_H_
+#define COVARIANCE_MODEL_H_
+
+#include <vector>
+
+#include "Matrix.h"
+
+
+namespace gaussmix
+{
+
+/*! \brief the structure imposed on the k covariance matrices of a mixture
+*
+* Whatever the structure, the covariances are exchanged as k m x m matrices, so a model can be saved,
+* scored or adapted by the same calls; the structure decides which entries are estimated and used.
+* Training estimates every structure on the scale of the full covariances: a structured estimate is
+* the full one projected onto the structure as constrainCovariances does it, so switching type does
+* not rescale the variances.
+*/
+enum CovarianceType
+{
+	COVARIANCE_FULL,      ///< k unconstrained covariances: O(m*m) per point and component, k factorizations
+	COVARIANCE_DIAGONAL,  ///< k diagonal covariances: O(m) per point and component, no factorizations
+	COVARIANCE_SPHERICAL, ///< k multiples of the identity: O(m) per point and component, no factorizations
+	COVARIANCE_TIED       ///< one full covariance shared by all k components: one factorization
+};
+
+/*! \brief project covariances onto a structure: zero the off-diagonals (diagonal), replace the diagonal
+*   by its mean (spherical) or replace every matrix by their weighted average (tied). Full is left as is.
+*
+@param[in] type structure to impose
+@param[in,out] sigma_matrix the k m x m covariance matrices
+@param[in] weights k weights for the tied average (e.g. the cluster weights)
+*/
+void constrainCovariances(CovarianceType type, std::vector<Matrix*> & sigma_matrix, const std::vector<double> & weights);
+
+
+/*! \brief a mixture prepared for scoring blocks of points: log(Pk) + log N(x | mu_k, sigma_k)
+*
+* Only what the structure needs is precomputed: a CholeskyBatch of all k covariances (full), a
+* single factor and the whitened means (tied), or the inverse variances (diagonal, spherical). The
+* diagonal and spherical scores are O(m) per point and component and make no LAPACK calls; tied
+* whitens a block once and reuses it for every component.
+*/
+class MixtureScorer
+{
+	public:
+	/** prepare a mixture for scoring
+	@param type structure of the covariances (diagonal and spherical read only the diagonals, tied only sigma_matrix[0])
+	@param sigma_matrix the k m x m covariance matrices
+	@param mu_matrix k x m matrix of cluster means
+	@param Pks the k cluster weights
+	@throw SizeError if the covariances and means do not agree in size
+	@throw LapackError if a covariance is not positive definite*/
+	MixtureScorer(CovarianceType type, const std::vector<Matrix*> & sigma_matrix, const Matrix & mu_matrix,
+			const std::vector<double> & Pks) throw (SizeError, LapackError);
+
+	/**@return the number of components (k)*/
+	int size() const { return k; }
+
+	/**@return the dimension of the data (m)*/
+	int dimension() const { return m; }
+
+	/** weighted log densities of a block of points, z[i*k + g] = log(Pk_g) + log N(x_i | mu_g, sigma_g)
+	@param count number of points in the block
+	@param X the points, a count x dimension() column-major block (one point per row, leading dimension count)
+	@param work scratch space for count*dimension() doubles
+	@param distances scratch space for count doubles
+	@param[out] z count rows of size() log densities*/
+	void logWeightedDensities(int count, const double X[], double work[], double distances[], double z[]) const;
+
+	private:
+	CovarianceType type;
+	int k;
+	int m;
+	CholeskyBatch factors;           ///< every covariance (full), the shared one (tied), or none
+	std::vector<double> means;       ///< k rows of m: the means, or for tied the whitened means inv(L)*mu
+	std::vector<double> precisions;  ///< k rows of m inverse variances (diagonal, spherical)
+	std::vector<double> logWeights;  ///< log(Pk) + the gaussian log normalizer, per component
+};
+
+}
+
+#endif /* COVARIANCE_MODEL_H_ */
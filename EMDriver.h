@@ -0,0 +1,137 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file EMDriver.h
+*   \brief the EM iteration shared by every trainer: alternate E-steps and M-steps until the likelihood settles
+*/
+#ifndef EM_DRIVER_H
+#define EM_DRIVER_H
+
+#include <cmath>
+
+#include "Matrix.h"
+#include "GaussMix.h"
+
+
+// smallest variance a component may have along a dimension (a dimension that is constant within a
+// cluster, as sparse data often has, would otherwise give a zero variance)
+const double VARIANCE_FLOOR = 1.0e-6;
+
+/*! \brief run EM from the parameters a trainer has already initialized
+*
+* Steps is anything with
+*   double estep(): score the data under the current parameters, keep what the next M-step needs and
+*                   return the log likelihood (over all nodes, under MPI)
+*   bool mstep():   re-estimate the parameters from the last E-step; false if that leaves a singular model
+*
+* Iteration stops when the likelihood changes by no more than epsilon, after max_iters M-steps, or when
+* the model becomes singular. A likelihood that is not finite (a NaN compares false against epsilon, and
+* would otherwise pass for convergence) counts as a singular model.
+@param[in,out] steps the trainer's E and M steps (and through them, its parameters)
+@param[in] max_iters maximum number of M-steps
+@param[out] op_likelihood log likelihood from the last E-step (left alone on GAUSSMIX_GENERAL_ERROR)
+@return one of the GAUSSMIX_ condition codes
+*/
+template<typename Steps>
+int runEM(Steps & steps, int max_iters, double * op_likelihood)
+{
+	//epsilon is the convergence criteria - the smaller epsilon, the narrower the convergence
+	double epsilon = 0.001;
+	int counter = 0;
+	int condition = gaussmix::GAUSSMIX_SUCCESS;
+	double old_likelihood = 0.0;
+	double new_likelihood = 0.0;
+
+	try
+	{
+		new_likelihood = steps.estep();
+	}
+	catch (...)
+	{
+		// if we can't do the first e-step, all bets are off
+		return gaussmix::GAUSSMIX_GENERAL_ERROR;
+	}
+	if (!std::isfinite(new_likelihood))
+		return gaussmix::GAUSSMIX_GENERAL_ERROR;
+
+	while ( (std::fabs(new_likelihood - old_likelihood) > epsilon) && (counter < max_iters))
+	{
+		old_likelihood = new_likelihood;
+
+		//if the m-step leaves a singular matrix, you can't do anything else
+		try
+		{
+			if (!steps.mstep())
+			{
+				condition = gaussmix::GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
+				break;
+			}
+		}
+		catch (LapackError &)
+		{
+			// only a model that survived at least one EM cycle is worth returning
+			if (counter < 1)
+				return gaussmix::GAUSSMIX_GENERAL_ERROR;
+			condition = gaussmix::GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
+			break;
+		}
+		catch (...)
+		{
+			return gaussmix::GAUSSMIX_GENERAL_ERROR;
+		}
+
+		try
+		{
+			new_likelihood = steps.estep();
+		}
+		catch (LapackError &)
+		{
+			condition = gaussmix::GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
+			break;
+		}
+		counter++;
+
+		if (!std::isfinite(new_likelihood))
+		{
+			condition = gaussmix::GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
+			break;
+		}
+	}
+
+	*op_likelihood = new_likelihood;
+
+	// no convergence or convergence? (a singular model keeps its own code)
+	if (condition == gaussmix::GAUSSMIX_SUCCESS)
+		condition = (counter == max_iters ? gaussmix::GAUSSMIX_MAX_ITERS_REACHED : gaussmix::GAUSSMIX_SUCCESS);
+
+	return condition;
+}
+
+#endif /* EM_DRIVER_H */
@@ -0,0 +1,716 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file FactorEM.cpp
+*   \brief implementations for EM on mixtures of factor analyzers (low-rank-plus-diagonal covariances)
+*
+* A component's covariance is Sigma = W*W' + D, with W m x r and D diagonal. By the Woodbury identity
+*
+*     inv(Sigma) = inv(D) - inv(D)*W*inv(M)*W'*inv(D),    det(Sigma) = det(M)*det(D),    M = I + W'*inv(D)*W
+*
+* so with M = L*L' and the r x m projection A = inv(L)*W'*inv(D), the Mahalanobis distance of e = x - mu
+* is e'*inv(D)*e - |A*e|^2: O(m*r) per point, and only the r x r matrix M is ever factored. Given the
+* point, the component's factors z have mean inv(L')*A*e and covariance inv(M). The M-step solves for
+* the loadings and the mean together (Ghahramani and Hinton, "The EM algorithm for mixtures of factor
+* analyzers", 1996) from the statistics
+*
+*     H = sum h,    sum h*e.*e,    S_xz = sum h*e*E[z~]',    S_zz = sum h*E[z~*z~']
+*
+* where h is the responsibility, z~ = [z; 1], and e is centered on the current mean (which keeps the
+* sums well conditioned). For a block of points, S_xz and S_zz are one matrix multiply each.
+*/
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <lapacke.h>
+#include <cblas.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#ifdef UseMPI
+#include "mpi.h"
+#endif /* UseMPI */
+
+#include "FactorEM.h"
+#include "GaussMix.h"
+#include "KMeans.h"
+#include "Kernels.h"
+#include "Reduction.h"
+#include "EMDriver.h"
+
+using namespace std;
+
+#define DEBUG 0
+
+// rows per block: a block gets one DGEMM per component for A*e and one for each of S_xz and S_zz
+#define FACTOR_BLOCK_SIZE 256
+
+/********************************************************************************************************
+ *                         PRIVATE TYPES AND FUNCTION PROTOTYPES
+ ********************************************************************************************************/
+
+namespace
+{
+
+/*! \brief parameters of a mixture of factor analyzers */
+struct FactorModel
+{
+	FactorModel(int k, int m, int r)
+		: k(k), m(m), r(r), mu((std::size_t)k*m, 0.0), var((std::size_t)k*m, 1.0),
+		  loadings((std::size_t)k*m*r, 0.0), Pks(k, 1.0/k) {}
+
+	int k; ///< number of components
+	int m; ///< dimension
+	int r; ///< number of factors
+	std::vector<double> mu; ///< means, k rows of m
+	std::vector<double> var; ///< diagonals of D, k rows of m
+	std::vector<double> loadings; ///< W, k m x r column-major matrices
+	std::vector<double> Pks; ///< cluster weights
+};
+
+/*! \brief the Woodbury form of every component (see the file comment), rebuilt by prepare_components */
+struct FactorComponents
+{
+	int k; ///< number of components
+	int m; ///< dimension
+	int r; ///< number of factors
+	std::vector<double> inv_var; ///< 1/D, k rows of m
+	std::vector<double> projection; ///< A = inv(L)*W'*inv(D), k r x m column-major matrices
+	std::vector<double> factor; ///< L, lower Cholesky factor of M = I + W'*inv(D)*W, k r x r column-major
+	std::vector<double> latent_cov; ///< inv(M), the posterior covariance of the factors, k r x r column-major
+	std::vector<double> log_const; ///< log(Pk_g) - 0.5*(m*log(2*pi) + log(det(Sigma_g))), one per component
+};
+
+/*! \brief EM sufficient statistics of every component, centered on the current means */
+struct FactorStatistics
+{
+	FactorStatistics(int k, int m, int r)
+		: k(k), m(m), r(r), weight(k, 0.0), squares((std::size_t)k*m, 0.0),
+		  cross((std::size_t)k*m*(r+1), 0.0), latent((std::size_t)k*(r+1)*(r+1), 0.0) {}
+
+	/** add another set of statistics (same k, m and r) to this one */
+	void add(const FactorStatistics & other);
+
+	int k; ///< number of components
+	int m; ///< dimension
+	int r; ///< number of factors
+	std::vector<double> weight; ///< H = sum of h, one per component
+	std::vector<double> squares; ///< sum of h*e.*e, k rows of m
+	std::vector<double> cross; ///< S_xz = sum of h*e*E[z~]', k m x (r+1) column-major
+	std::vector<double> latent; ///< sum of h*E[z~]*E[z~]', k (r+1) x (r+1) column-major (without inv(M))
+};
+
+bool prepare_components(const FactorModel & model, FactorComponents & components);
+
+void center_block(int count, int m, const double points[], const double mu[], double centered[]);
+
+void score_block(const FactorModel & model, const FactorComponents & components, int count, const double points[],
+        double centered[], double projected[], double z[]);
+
+template<typename T>
+double accumulate_statistics(const BasicMatrixView<T> & X, const FactorModel & model,
+        const FactorComponents & components, FactorStatistics & stats);
+
+void reduceInto(FactorStatistics & total, const FactorStatistics & part);
+
+bool update_parameters(const FactorStatistics & stats, const FactorComponents & components,
+        const FactorModel & model, FactorModel & updated);
+
+bool read_model(const std::vector<Matrix*> & loading_matrix, const Matrix & variance_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks, FactorModel & model);
+
+void write_model(const FactorModel & model, std::vector<Matrix*> & loading_matrix, Matrix & variance_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks);
+
+/*! \brief a mixture of factor analyzers as runEM sees it. The M-step builds the new parameters beside the
+ *  old ones (its statistics are centered on the old means) and only takes them once they have been prepared.
+ */
+template<typename T>
+struct FactorSteps
+{
+	FactorSteps(const BasicMatrixView<T> & X, FactorModel & model, FactorComponents & components)
+		: X(X), model(model), components(components), updated(model.k, model.m, model.r),
+		  stats(model.k, model.m, model.r) {}
+
+	double estep() { return accumulate_statistics(X, model, components, stats); }
+	bool mstep()
+	{
+		if (!update_parameters(stats, components, model, updated) || !prepare_components(updated, components))
+			return false;
+		std::swap(model, updated);
+		return true;
+	}
+
+	const BasicMatrixView<T> & X; ///< the data
+	FactorModel & model; ///< current parameters
+	FactorComponents & components; ///< the prepared components of model
+	FactorModel updated; ///< parameters being estimated
+	FactorStatistics stats; ///< statistics of the last pass
+};
+
+template<typename T>
+int train_factor_view(int k, int rank, int max_iters, const BasicMatrixView<T> & X, std::vector<Matrix*> & loading_matrix,
+        Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood);
+
+template<typename T>
+void pdf_mix_factor_view(const BasicMatrixView<T> & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+        const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[]);
+
+/*************************************************************************************************************
+ *                            PRIVATE FUNCTIONS
+ **************************************************************************************************************/
+
+void FactorStatistics::add(const FactorStatistics & other)
+{
+    for (std::size_t i = 0; i < weight.size(); i++)
+        weight[i] += other.weight[i];
+    for (std::size_t i = 0; i < squares.size(); i++)
+        squares[i] += other.squares[i];
+    for (std::size_t i = 0; i < cross.size(); i++)
+        cross[i] += other.cross[i];
+    for (std::size_t i = 0; i < latent.size(); i++)
+        latent[i] += other.latent[i];
+}
+
+/*! \brief reduceInto add part's H, squares, S_xz and S_zz to total's: the combining step of treeReduce */
+void reduceInto(FactorStatistics & total, const FactorStatistics & part)
+{
+    total.add(part);
+}
+
+/*! \brief prepare_components factor M = I + W'*inv(D)*W for every component and compute the projections
+ *  and log normalizers the E-step needs. O(m*r*r + r*r*r) per component.
+ *
+ * @param model the parameters
+ * @param[out] components the prepared components
+ * @return true on success, false if a variance is not positive or M is not positive definite
+ */
+bool prepare_components(const FactorModel & model, FactorComponents & components)
+{
+    int k = model.k;
+    int m = model.m;
+    int r = model.r;
+
+    components.k = k;
+    components.m = m;
+    components.r = r;
+    components.inv_var.resize((std::size_t)k*m);
+    components.projection.resize((std::size_t)k*r*m);
+    components.factor.resize((std::size_t)k*r*r);
+    components.latent_cov.resize((std::size_t)k*r*r);
+    components.log_const.resize(k);
+
+    for (int g = 0; g < k; g++)
+    {
+        const double * W = &model.loadings[(std::size_t)g*m*r];
+        const double * var = &model.var[(std::size_t)g*m];
+        double * inv_var = &components.inv_var[(std::size_t)g*m];
+        double * A = &components.projection[(std::size_t)g*r*m];
+        double * L = &components.factor[(std::size_t)g*r*r];
+        double * latent_cov = &components.latent_cov[(std::size_t)g*r*r];
+
+        double log_det = 0.0;
+        for (int j = 0; j < m; j++)
+        {
+            if (!(var[j] > 0.0))
+                return false;
+            inv_var[j] = 1.0/var[j];
+            log_det += log(var[j]);
+        }
+
+        // W'*inv(D), r x m
+        for (int j = 0; j < m; j++)
+            for (int c = 0; c < r; c++)
+                A[c + (std::size_t)j*r] = W[j + (std::size_t)c*m]*inv_var[j];
+
+        // M = I + W'*inv(D)*W, then M = L*L'
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, r, r, m, 1.0, A, r, W, m, 0.0, L, r);
+        for (int c = 0; c < r; c++)
+            L[c + c*r] += 1.0;
+        if (LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'L', r, L, r) != 0)
+            return false;
+        for (int j = 0; j < r; j++)
+        {
+            for (int i = 0; i < j; i++)
+                L[i + j*r] = 0.0;
+            log_det += 2.0*log(L[j + j*r]);
+        }
+
+        // inv(M), from its factor
+        std::copy(L, L + (std::size_t)r*r, latent_cov);
+        if (LAPACKE_dpotri(LAPACK_COL_MAJOR, 'L', r, latent_cov, r) != 0)
+            return false;
+        for (int j = 0; j < r; j++)
+            for (int i = 0; i < j; i++)
+                latent_cov[i + j*r] = latent_cov[j + i*r];
+
+        // A = inv(L)*W'*inv(D)
+        cblas_dtrsm(CblasColMajor, CblasLeft, CblasLower, CblasNoTrans, CblasNonUnit, r, m, 1.0, L, r, A, r);
+
+        components.log_const[g] = log(model.Pks[g]) - 0.5*(m*log(2*M_PI) + log_det);
+    }
+    return true;
+}
+
+/*! \brief center_block subtract a mean from every point of a block
+ *
+ * @param count number of points
+ * @param m dimension
+ * @param points count x m column-major block
+ * @param mu the mean
+ * @param[out] centered count x m column-major block of points - mu
+ */
+void center_block(int count, int m, const double points[], const double mu[], double centered[])
+{
+    for (int j = 0; j < m; j++)
+    {
+        const double * x = points + (std::size_t)j*count;
+        double * e = centered + (std::size_t)j*count;
+        for (int i = 0; i < count; i++)
+            e[i] = x[i] - mu[j];
+    }
+}
+
+/*! \brief score_block log(Pk_g) + log N(x | mu_g, W_g*W_g' + D_g) of a block of points under every component
+ *
+ * @param model the parameters
+ * @param components prepared components
+ * @param count number of points
+ * @param points count x m column-major block of points
+ * @param centered scratch space for count*m doubles
+ * @param[out] projected A_g*(x - mu_g) for every component: k count x r column-major blocks
+ * @param[out] z count rows of k log weighted densities
+ */
+void score_block(const FactorModel & model, const FactorComponents & components, int count, const double points[],
+        double centered[], double projected[], double z[])
+{
+    int k = model.k;
+    int m = model.m;
+    int r = model.r;
+    double distances[count];
+
+    for (int g = 0; g < k; g++)
+    {
+        center_block(count, m, points, &model.mu[(std::size_t)g*m], centered);
+
+        // e'*inv(D)*e
+        const double * inv_var = &components.inv_var[(std::size_t)g*m];
+        for (int i = 0; i < count; i++)
+            distances[i] = 0.0;
+        for (int j = 0; j < m; j++)
+        {
+            const double * e = centered + (std::size_t)j*count;
+            for (int i = 0; i < count; i++)
+                distances[i] += e[i]*e[i]*inv_var[j];
+        }
+
+        // less |A*e|^2, for every point at once: P = E*A'
+        double * P = projected + (std::size_t)g*count*r;
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, count, r, m, 1.0, centered, count,
+                &components.projection[(std::size_t)g*r*m], r, 0.0, P, count);
+        for (int c = 0; c < r; c++)
+        {
+            const double * p = P + (std::size_t)c*count;
+            for (int i = 0; i < count; i++)
+                distances[i] -= p[i]*p[i];
+        }
+
+        for (int i = 0; i < count; i++)
+            z[(std::size_t)i*k + g] = components.log_const[g] - 0.5*distances[i];
+    }
+}
+
+/*! \brief accumulate_statistics the E-step: responsibilities h and expected factors E[z] of every point,
+ *  kept only as the sums H, sum h*e.*e, S_xz and S_zz of the file comment
+ *
+ * @param X view of the n x m data
+ * @param model current parameters; e is taken about its means
+ * @param components model, prepared by prepare_components
+ * @param[out] stats the sums, overwritten (and all-reduced across nodes, under MPI)
+ * @return log likelihood of X under model (of all the nodes' rows, under MPI)
+ */
+template<typename T>
+double accumulate_statistics(const BasicMatrixView<T> & X, const FactorModel & model,
+        const FactorComponents & components, FactorStatistics & stats)
+{
+    int n = X.rowCount();
+    int m = model.m;
+    int k = model.k;
+    int r = model.r;
+
+    // each thread folds its blocks of points into its own statistics; treeReduce adds them up below
+    std::vector<FactorStatistics> thread_stats(accumulatorCount(), FactorStatistics(k, m, r));
+
+    int num_blocks = (n + FACTOR_BLOCK_SIZE - 1)/FACTOR_BLOCK_SIZE;
+    std::vector<double> block_likelihood(num_blocks, 0.0);
+
+#ifdef _OPENMP
+    # pragma omp parallel
+#endif /* _OPENMP */
+    {
+        FactorStatistics & local = thread_stats[accumulatorIndex()];
+
+        std::vector<double> points((std::size_t)FACTOR_BLOCK_SIZE*m);
+        std::vector<double> centered((std::size_t)FACTOR_BLOCK_SIZE*m);
+        std::vector<double> projected((std::size_t)FACTOR_BLOCK_SIZE*r*k);
+        std::vector<double> z((std::size_t)FACTOR_BLOCK_SIZE*k);
+        std::vector<double> h(FACTOR_BLOCK_SIZE);
+        std::vector<double> latent((std::size_t)FACTOR_BLOCK_SIZE*(r+1));
+        std::vector<double> weighted((std::size_t)FACTOR_BLOCK_SIZE*(r+1));
+
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int first = block*FACTOR_BLOCK_SIZE;
+            int count = std::min(FACTOR_BLOCK_SIZE, n - first);
+            X.copyRowBlock(first, count, &points[0], count);
+
+            // Woodbury scores, normalized in place into log h (a row of k per point); projected keeps A*e
+            score_block(model, components, count, &points[0], &centered[0], &projected[0], &z[0]);
+            double partial = 0.0;
+            for (int i = 0; i < count; i++)
+                partial += logNormalize(k, &z[(std::size_t)i*k]);
+            block_likelihood[block] = partial;
+
+            // then component by component: h, E[z] from A*e, and the block's share of each sum
+            for (int g = 0; g < k; g++)
+            {
+                double w = 0.0;
+                for (int i = 0; i < count; i++)
+                {
+                    h[i] = exp(z[(std::size_t)i*k + g]);
+                    w += h[i];
+                }
+                local.weight[g] += w;
+
+                // expected factors, E[z]' = (A*e)'*inv(L), then z~ = [E[z]; 1] and h.*z~, a row per point
+                double * P = &projected[(std::size_t)g*count*r];
+                cblas_dtrsm(CblasColMajor, CblasRight, CblasLower, CblasNoTrans, CblasNonUnit, count, r, 1.0,
+                        &components.factor[(std::size_t)g*r*r], r, P, count);
+                for (int c = 0; c <= r; c++)
+                {
+                    double * l = &latent[(std::size_t)c*count];
+                    double * v = &weighted[(std::size_t)c*count];
+                    for (int i = 0; i < count; i++)
+                    {
+                        l[i] = (c < r) ? P[(std::size_t)c*count + i] : 1.0;
+                        v[i] = h[i]*l[i];
+                    }
+                }
+
+                // sum of h*e.*e
+                center_block(count, m, &points[0], &model.mu[(std::size_t)g*m], &centered[0]);
+                double * squares = &local.squares[(std::size_t)g*m];
+                for (int j = 0; j < m; j++)
+                {
+                    const double * e = &centered[(std::size_t)j*count];
+                    double s = 0.0;
+                    for (int i = 0; i < count; i++)
+                        s += h[i]*e[i]*e[i];
+                    squares[j] += s;
+                }
+
+                // S_xz += E'*(h.*z~), S_zz += z~'*(h.*z~)
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, m, r+1, count, 1.0, &centered[0], count,
+                        &weighted[0], count, 1.0, &local.cross[(std::size_t)g*m*(r+1)], m);
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, r+1, r+1, count, 1.0, &latent[0], count,
+                        &weighted[0], count, 1.0, &local.latent[(std::size_t)g*(r+1)*(r+1)], r+1);
+            }
+        }
+    }
+
+    treeReduce(thread_stats);
+    stats = thread_stats[0];
+
+    double likelihood = 0.0;
+    for (int block = 0; block < num_blocks; block++)
+        likelihood += block_likelihood[block];
+
+#ifdef UseMPI
+    double total_likelihood;
+    MPI_Allreduce(&likelihood, &total_likelihood, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    likelihood = total_likelihood;
+    MPI_Allreduce(MPI_IN_PLACE, &stats.weight[0], k, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.squares[0], k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.cross[0], k*m*(r+1), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.latent[0], k*(r+1)*(r+1), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif /* UseMPI */
+
+    return likelihood;
+}
+
+/*! \brief update_parameters the M-step: new weights, means, loadings and variances from the statistics
+ *
+ * [W mu-c] solves S_zz*[W mu-c]' = S_xz', where S_zz gets H*inv(M) added to its factor block (the
+ * posterior covariance of the factors), and D = diag(sum h*e.*e - [W mu-c]*S_xz')/H.
+ *
+ * @param stats H and the sums of the last E-step, about the current means
+ * @param components the prepared components the statistics were accumulated with
+ * @param model current parameters
+ * @param[out] updated the new parameters
+ * @return true on success, false if a component is empty or its factor statistics are singular
+ */
+bool update_parameters(const FactorStatistics & stats, const FactorComponents & components,
+        const FactorModel & model, FactorModel & updated)
+{
+    int k = model.k;
+    int m = model.m;
+    int r = model.r;
+    int r1 = r + 1;
+
+    updated = model;
+
+    double total_weight = 0.0;
+    for (int g = 0; g < k; g++)
+        total_weight += stats.weight[g];
+
+    std::vector<double> Q((std::size_t)r1*r1);
+    std::vector<double> B((std::size_t)r1*m);
+    for (int g = 0; g < k; g++)
+    {
+        double H = stats.weight[g];
+        if (!(H > 0.0))
+            return false;
+        updated.Pks[g] = H/total_weight;
+
+        const double * latent = &stats.latent[(std::size_t)g*r1*r1];
+        const double * latent_cov = &components.latent_cov[(std::size_t)g*r*r];
+        const double * cross = &stats.cross[(std::size_t)g*m*r1];
+        for (int b = 0; b < r1; b++)
+            for (int a = 0; a < r1; a++)
+                Q[a + b*r1] = latent[a + b*r1] + ((a < r && b < r) ? H*latent_cov[a + b*r] : 0.0);
+        for (int j = 0; j < m; j++)
+            for (int a = 0; a < r1; a++)
+                B[a + (std::size_t)j*r1] = cross[j + (std::size_t)a*m];
+
+        if (LAPACKE_dposv(LAPACK_COL_MAJOR, 'L', r1, m, &Q[0], r1, &B[0], r1) != 0)
+            return false;
+
+        for (int j = 0; j < m; j++)
+        {
+            const double * solution = &B[(std::size_t)j*r1];
+            double explained = 0.0;
+            for (int a = 0; a < r1; a++)
+                explained += solution[a]*cross[j + (std::size_t)a*m];
+            for (int c = 0; c < r; c++)
+                updated.loadings[(std::size_t)g*m*r + j + (std::size_t)c*m] = solution[c];
+            updated.mu[(std::size_t)g*m + j] += solution[r];
+
+            // a dimension the factors explain completely would give a zero, and D must stay positive definite
+            double v = (stats.squares[(std::size_t)g*m + j] - explained)/H;
+            updated.var[(std::size_t)g*m + j] = (v > VARIANCE_FLOOR) ? v : VARIANCE_FLOOR;
+        }
+    }
+    return true;
+}
+
+/*! \brief read_model copy a mixture of factor analyzers out of the public representation
+ *
+ * @param loading_matrix k m x r loading matrices
+ * @param variance_matrix k x m diagonals
+ * @param mu_matrix k x m means
+ * @param Pks k cluster weights
+ * @param[out] model the parameters (must be constructed with the right k, m and r)
+ * @return true on success, false if the sizes do not agree
+ */
+bool read_model(const std::vector<Matrix*> & loading_matrix, const Matrix & variance_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks, FactorModel & model)
+{
+    int k = model.k;
+    int m = model.m;
+    int r = model.r;
+
+    if ((int)loading_matrix.size() != k || (int)Pks.size() != k || variance_matrix.rowCount() != k ||
+            variance_matrix.colCount() != m || mu_matrix.rowCount() != k || mu_matrix.colCount() != m)
+        return false;
+
+    for (int g = 0; g < k; g++)
+    {
+        if (loading_matrix[g]->rowCount() != m || loading_matrix[g]->colCount() != r)
+            return false;
+        for (int j = 0; j < m; j++)
+        {
+            model.mu[(std::size_t)g*m + j] = mu_matrix.getValue(g,j);
+            model.var[(std::size_t)g*m + j] = variance_matrix.getValue(g,j);
+            for (int c = 0; c < r; c++)
+                model.loadings[(std::size_t)g*m*r + j + (std::size_t)c*m] = loading_matrix[g]->getValue(j,c);
+        }
+        model.Pks[g] = Pks[g];
+    }
+    return true;
+}
+
+/*! \brief write_model copy a mixture of factor analyzers into the public representation
+ *
+ * @param model the parameters
+ * @param[out] loading_matrix k m x r loading matrices (caller allocates)
+ * @param[out] variance_matrix k x m diagonals (caller allocates)
+ * @param[out] mu_matrix k x m means (caller allocates)
+ * @param[out] Pks k cluster weights
+ */
+void write_model(const FactorModel & model, std::vector<Matrix*> & loading_matrix, Matrix & variance_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks)
+{
+    int k = model.k;
+    int m = model.m;
+    int r = model.r;
+
+    for (int g = 0; g < k; g++)
+        for (int j = 0; j < m; j++)
+        {
+            mu_matrix.update(model.mu[(std::size_t)g*m + j], g, j);
+            variance_matrix.update(model.var[(std::size_t)g*m + j], g, j);
+            for (int c = 0; c < r; c++)
+                loading_matrix[g]->update(model.loadings[(std::size_t)g*m*r + j + (std::size_t)c*m], j, c);
+        }
+    Pks = model.Pks;
+}
+
+template<typename T>
+int train_factor_view(int k, int rank, int max_iters, const BasicMatrixView<T> & X, std::vector<Matrix*> & loading_matrix,
+        Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    int m = X.colCount();
+    int r = rank;
+
+    if (k < 1 || r < 1 || r >= m || (int)loading_matrix.size() != k || variance_matrix.rowCount() != k ||
+            variance_matrix.colCount() != m || mu_matrix.rowCount() != k || mu_matrix.colCount() != m)
+        return gaussmix::GAUSSMIX_GENERAL_ERROR;
+    for (int g = 0; g < k; g++)
+        if (loading_matrix[g]->rowCount() != m || loading_matrix[g]->colCount() != r)
+            return gaussmix::GAUSSMIX_GENERAL_ERROR;
+
+    //start from the kmeans means, unit variances and equal weights, with small pseudo-random loadings
+    //(zero loadings would stay zero), the same on every run and every node
+    FactorModel model(k, m, r);
+    double * kmeans_mu = gaussmix::kmeans(X, k);
+    if (0 == kmeans_mu)
+        return gaussmix::GAUSSMIX_GENERAL_ERROR;
+    std::copy(kmeans_mu, kmeans_mu + (std::size_t)k*m, model.mu.begin());
+    delete[] kmeans_mu;
+
+    unsigned int seed = 1;
+    for (std::size_t i = 0; i < model.loadings.size(); i++)
+    {
+        seed = seed*1103515245u + 12345u;
+        model.loadings[i] = 0.1*((double)((seed >> 16) & 0x7fff)/0x7fff - 0.5);
+    }
+
+    FactorComponents components;
+    if (!prepare_components(model, components))
+        return gaussmix::GAUSSMIX_GENERAL_ERROR;
+
+    //a component that empties, or whose loadings leave M singular, stops EM as non-invertible
+    FactorSteps<T> steps(X, model, components);
+    int condition = runEM(steps, max_iters, op_likelihood);
+
+    write_model(model, loading_matrix, variance_matrix, mu_matrix, Pks);
+    return condition;
+}
+
+template<typename T>
+void pdf_mix_factor_view(const BasicMatrixView<T> & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+        const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[])
+{
+    int k = Pks.size();
+    int m = X.colCount();
+    int r = loading_matrix.empty() ? 0 : loading_matrix[0]->colCount();
+
+    if (first < 0 || count < 0 || first + count > X.rowCount())
+        throw SizeError("Error: rows to score are outside the data");
+
+    FactorModel model(k, m, r);
+    if (!read_model(loading_matrix, variance_matrix, mu_matrix, Pks, model))
+        throw SizeError("Error: loading, variance and mean matrices must be k m x r, k x m and k x m");
+
+    FactorComponents components;
+    if (!prepare_components(model, components))
+        throw LapackError("Error: a factor analyzer covariance is not positive definite");
+
+    int num_blocks = (count + FACTOR_BLOCK_SIZE - 1)/FACTOR_BLOCK_SIZE;
+#ifdef _OPENMP
+    # pragma omp parallel if (num_blocks > 1)
+#endif /* _OPENMP */
+    {
+        std::vector<double> points((std::size_t)FACTOR_BLOCK_SIZE*m);
+        std::vector<double> centered((std::size_t)FACTOR_BLOCK_SIZE*m);
+        std::vector<double> projected((std::size_t)FACTOR_BLOCK_SIZE*r*k);
+        std::vector<double> z((std::size_t)FACTOR_BLOCK_SIZE*k);
+
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int offset = block*FACTOR_BLOCK_SIZE;
+            int block_count = std::min(FACTOR_BLOCK_SIZE, count - offset);
+            X.copyRowBlock(first + offset, block_count, &points[0], block_count);
+            score_block(model, components, block_count, &points[0], &centered[0], &projected[0], &z[0]);
+            for (int i = 0; i < block_count; i++)
+                log_likelihoods[offset + i] = logSumExp(k, &z[(std::size_t)i*k]);
+        }
+    }
+}
+
+} // namespace
+
+/******************************************************************
+ *                        IMPLEMENTATIONS OF PUBLIC FUNCTIONS
+ ******************************************************************/
+
+int gaussmix::train_factor_analyzers(int k, int rank, int max_iters, const MatrixView & X, std::vector<Matrix*> & loading_matrix,
+        Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    return train_factor_view(k, rank, max_iters, X, loading_matrix, variance_matrix, mu_matrix, Pks, op_likelihood);
+}
+
+int gaussmix::train_factor_analyzers(int k, int rank, int max_iters, const FloatMatrixView & X, std::vector<Matrix*> & loading_matrix,
+        Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    return train_factor_view(k, rank, max_iters, X, loading_matrix, variance_matrix, mu_matrix, Pks, op_likelihood);
+}
+
+void gaussmix::pdf_mix_factor_analyzers(const MatrixView & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+        const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[])
+{
+    pdf_mix_factor_view(X, first, count, loading_matrix, variance_matrix, mu_matrix, Pks, log_likelihoods);
+}
+
+void gaussmix::pdf_mix_factor_analyzers(const FloatMatrixView & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+        const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[])
+{
+    pdf_mix_factor_view(X, first, count, loading_matrix, variance_matrix, mu_matrix, Pks, log_likelihoods);
+}
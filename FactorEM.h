@@ -0,0 +1,99 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file FactorEM.h
+*   \brief definitions for EM on mixtures of factor analyzers (low-rank-plus-diagonal covariances)
+*/
+
+#ifndef FACTOR_EM_H_
+#define FACTOR_EM_H_
+
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+
+
+namespace gaussmix
+{
+
+/*! \brief train_factor_analyzers: train a Gaussian Mixture model whose covariances are W*W' + D
+*
+* Each component has an m x r loading matrix W and a diagonal D, so the model is O(k*m*r) and no
+* m x m matrix is ever formed. Densities use the Woodbury identity: only r x r matrices are factored,
+* and a point costs O(m*r) per component. Like train_streaming, each iteration is one pass over the
+* data that folds the responsibilities (and the expected latent factors) of a block of points straight
+* into per-component sufficient statistics. The M-step is the exact one for the mean and loadings
+* together; variances are floored at a small positive value. Starts from the kmeans means, unit
+* variances, equal weights and small fixed pseudo-random loadings.
+*
+@param[in] k number of clusters
+@param[in] rank number of factors r per cluster (1 <= r < m)
+@param[in] max_iters max number of EM iterations
+@param[in] X n x m data points (local rows, under MPI)
+@param[out] loading_matrix k m x r loading matrices W (caller allocates)
+@param[out] variance_matrix k x m matrix of the diagonals D (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes
+*/
+int train_factor_analyzers(int k, int rank, int max_iters, const MatrixView & X, std::vector<Matrix*> & loading_matrix,
+		Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * likelihood);
+
+/*! \brief train_factor_analyzers: as above, for float32 data (statistics are accumulated in double)
+*/
+int train_factor_analyzers(int k, int rank, int max_iters, const FloatMatrixView & X, std::vector<Matrix*> & loading_matrix,
+		Matrix & variance_matrix, Matrix & mu_matrix, std::vector<double> & Pks, double * likelihood);
+
+/*! \brief pdf_mix_factor_analyzers: log of the mixture density of some rows of X under a mixture of factor analyzers
+*
+@param[in] X data points
+@param[in] first 0-rel first row to score
+@param[in] count number of rows to score
+@param[in] loading_matrix k m x r loading matrices W
+@param[in] variance_matrix k x m matrix of the diagonals D
+@param[in] mu_matrix k x m matrix of cluster means
+@param[in] Pks cluster weights
+@param[out] log_likelihoods the count log likelihoods
+@throw SizeError if the rows are outside X or the matrix sizes do not agree
+@throw LapackError if a covariance is not positive definite
+*/
+void pdf_mix_factor_analyzers(const MatrixView & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+		const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[]);
+
+/*! \brief pdf_mix_factor_analyzers: as above, for float32 data
+*/
+void pdf_mix_factor_analyzers(const FloatMatrixView & X, int first, int count, const std::vector<Matrix*> & loading_matrix,
+		const Matrix & variance_matrix, const Matrix & mu_matrix, const std::vector<double> & Pks, double log_likelihoods[]);
+
+}
+
+#endif /* FACTOR_EM_H_ */
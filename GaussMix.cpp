@@ -128,12 +128,17 @@
 * three-dimensional data points falling into two clusters centered on (1,1,1) and (100,100,100). The second is similarly
 * distributed, with a "+1" cluster centered on (10,10,10) and "-1" cluster centered on (50,50,50).
 *
-* 3. The Matrix.h/ cpp code wraps LAPACK routines. To work with these routines efficiently, the Matrix class maintains
-* internal buffers that may be modified by operations that, from a semantic point of view, are read-only. Hence many
-* libGauss routines take non-const Matrix arguments, where const Matrix arguments would be typically be used.
+* 3. The Matrix.h/ cpp code wraps LAPACK routines. A Matrix keeps a single column-major buffer that is handed to LAPACK
+* directly, and its read-only operations (det, inv, cholesky, ...) are const and work on copies, so they never modify
+* shared state. The scoring routines take const model arguments, and several threads may score against one model
+* concurrently without copying it or serializing access.
 *
-* 4. For compilers that support it, the code is configured to use open mp (www.openmp.org) to parallelize various for loops,
-* where the loop is over the cluster of the Gaussian Mixture Model.
+* 4. For compilers that support it, the code is configured to use open mp (www.openmp.org) to parallelize over blocks of
+* data points rather than over the clusters of the Gaussian Mixture Model. The E-step scores each block against every
+* cluster and sums the per-block likelihoods in block order. The M-step (and the streaming, sparse and factor analyzer
+* trainers) give each thread its own accumulators for the statistics of its blocks, and combine them afterwards with
+* a pairwise tree reduction (Reduction.h). The results are identical from run to run for a fixed number of threads;
+* a different number of threads may change them in the last few bits.
 * .
 * \section References
 *
@@ -200,6 +205,7 @@ static bool isProgBuilt = false;
 #endif /* OPENCL */
 
 #include <lapacke.h>
+#include <cblas.h>
 
 // for kmeans utils
 #include "KMeans.h"
@@ -207,9 +213,33 @@ static bool isProgBuilt = false;
 // for adaptation utils
 #include "Adapt.h"
 
+// for training on sparse data
+#include "SparseEM.h"
+
+// for training without storing responsibilities
+#include "StreamingEM.h"
+
+// for mixtures of factor analyzers
+#include "FactorEM.h"
+
+// for per-thread accumulators
+#include "Reduction.h"
+
 //API header file
 #include "GaussMix.h"
 
+// fixed-dimension kernels for small covariance matrices
+#include "SmallMatrix.h"
+
+// packed storage for covariance accumulation
+#include "SymmetricMatrix.h"
+
+// runtime-dispatched vector kernels
+#include "Kernels.h"
+
+// the EM iteration shared with the other trainers
+#include "EMDriver.h"
+
 // for error handling in C libraries
 #include <errno.h>
 
@@ -222,6 +252,15 @@ static bool isProgBuilt = false;
 
 #define MAX_LINE_SIZE 1000
 
+//ESTEP_BLOCK_SIZE is the number of data points per unit of work in estep. The per-block likelihoods
+//are summed in block order, so the result does not depend on the number of threads.
+#define ESTEP_BLOCK_SIZE 256
+
+//ESTEP_TILE_BYTES is roughly how much of the (per-core L2) cache estep may fill with covariance factors
+//before it tiles the gaussians; each tile of gaussians then covers ESTEP_TILE_BLOCKS blocks of points
+#define ESTEP_TILE_BYTES (256*1024)
+#define ESTEP_TILE_BLOCKS 8
+
 /*
  * SET THIS TO 1 FOR DEBUGGING STATEMENT SUPPORT (via std out)
  */
@@ -233,12 +272,159 @@ using namespace std;
  *                         PRIVATE FUNCTION PROTOTYPES
  ********************************************************************************************************/
 
-// EM helper functions
-double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const std::vector<Matrix *> &sigma_matrix, \
+// EM helper functions (T is the scalar type of the data: double or float)
+template<typename T>
+double estep(int n, int m, int k, const BasicMatrixView<T> &X,  Matrix &p_nk_matrix, const std::vector<Matrix *> &sigma_matrix, \
                   const Matrix &mu_matrix, const std::vector<double> &Pk_vec);
-bool mstep(int n, int m, int k, const double *X, const Matrix &p_nk_matrix, Matrix *sigma_matrix, \
+template<typename T>
+bool mstep(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, std::vector<Matrix *> &sigma_matrix, \
                   Matrix &mu_matrix, std::vector<double> &Pk_vec);
+template<typename T>
+void mstep_weights_and_means(int n, int m, int k, const BasicMatrixView<T> &X, const Matrix &p_nk_matrix, \
+                  Matrix &mu_matrix, std::vector<double> &Pk_vec, double unscaled_Pk_vec[]);
+template<typename T>
+double estep_structured(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, \
+                  const std::vector<Matrix *> &sigma_matrix, const Matrix &mu_matrix, const std::vector<double> &Pk_vec, \
+                  gaussmix::CovarianceType covariance);
+template<typename T>
+bool mstep_structured(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, \
+                  std::vector<Matrix *> &sigma_matrix, Matrix &mu_matrix, std::vector<double> &Pk_vec, \
+                  gaussmix::CovarianceType covariance);
 double * matrixToRaw(const Matrix & X);
+void check_mixture_size(int k, int components, const Matrix &variance_matrix, const Matrix &mu_matrix,
+                  const std::vector<double> &Pks);
+void check_mixture_size(int k, const vector<Matrix*> &sigma_matrix, const Matrix &mu_matrix,
+                  const std::vector<double> &Pks);
+int parse_svm_line(char * buffer, int m, int & label, std::vector<int> & columns, std::vector<double> & values);
+
+// bodies of the public entry points, shared by the double and float data overloads
+template<typename T>
+int train(int n, int m, int k, int max_iters, const BasicMatrixView<T> &X, vector<Matrix*> &sigma_matrix,
+                  Matrix &mu_matrix, std::vector<double> &Pks, double *op_likelihood, gaussmix::CovarianceType covariance);
+template<typename T>
+double log_pdf(const BasicMatrixView<T> &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector);
+template<typename T>
+double log_pdf_mix(const BasicMatrixView<T> &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+                  const Matrix &mu_matrix, const std::vector<double> &Pks, gaussmix::CovarianceType covariance);
+template<typename T>
+double log_pdf_mix_rows(const BasicMatrixView<T> &X, int k, const vector<Matrix*> &sigma_matrix,
+                  const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+                  gaussmix::CovarianceType covariance);
+
+/*! \brief fixed-dimension body of estep (non-OpenCL): computes the log p_nk's of every data point
+*   and returns the (local) log likelihood. Used in place of the general loop when m <= SMALL_MATRIX_MAX_DIM.
+*/
+template<int M>
+struct EstepFixed
+{
+    template<typename T>
+    static double run(int n, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, const std::vector<Matrix *> &sigma_matrix,
+                      const Matrix &mu_matrix, const std::vector<double> &Pk_vec)
+    {
+        //factor all covariances at once, and keep the means and log weights next to the factors
+        CholeskyBatch factors(sigma_matrix);
+        const double *log_norm_factors = factors.logNormalizers();
+        std::vector<double> log_Pks(k);
+        const int mu_ld = paddedLeadingDimension(M);
+        AlignedVector<double> mu_rows(k*mu_ld, 0.0);
+        for (int gauss = 0; gauss < k; gauss++)
+        {
+            log_Pks[gauss] = log(Pk_vec[gauss]);
+            for (int dim = 0; dim < M; dim++)
+                mu_rows[gauss*mu_ld + dim] = mu_matrix.getValue(gauss,dim);
+        }
+
+        //p_nk_matrix is column-major, one column per gaussian
+        double *p_nk = p_nk_matrix.getArray();
+        int ld = p_nk_matrix.rowCount();
+
+        //blocks of points are shared out among the threads; each block keeps its own likelihood
+        int num_blocks = (n + ESTEP_BLOCK_SIZE - 1)/ESTEP_BLOCK_SIZE;
+        std::vector<double> block_likelihood(num_blocks, 0.0);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            double scratch[M];
+            double z[k];
+            double partial = 0.0;
+            int end = std::min(n, (block+1)*ESTEP_BLOCK_SIZE);
+            for (int data_point = block*ESTEP_BLOCK_SIZE; data_point < end; data_point++)
+            {
+                const double *x = X.row(data_point, scratch);
+
+                //log of the cluster weighted density under each gaussian
+                for (int gaussian = 0; gaussian < k; gaussian++)
+                    z[gaussian] = log_Pks[gaussian] + log_norm_factors[gaussian] +
+                                  (-0.5*whitenedSquaredNorm<M>(factors.whitener(gaussian), x, &mu_rows[gaussian*mu_ld]));
+
+                //log of total density for data point; z becomes the normalized log probabilities per cluster
+                double log_P_xn = logNormalize(k, z);
+
+                for (int gaussian = 0; gaussian < k; gaussian++)
+                    p_nk[gaussian*ld + data_point] = z[gaussian];
+
+                partial += log_P_xn;
+            }
+            block_likelihood[block] = partial;
+        }
+
+        double likelihood = 0.0;
+        for (int block = 0; block < num_blocks; block++)
+            likelihood += block_likelihood[block];
+        return likelihood;
+    }
+};
+
+/*! \brief fixed-dimension scatter accumulation of mstep: adds exp(p_nk) * (x - mu)*transpose(x - mu)
+*   of data points first .. end-1 to k packed (upper triangle) M x M accumulators
+*/
+template<int M>
+struct MstepScatterFixed
+{
+    template<typename T>
+    static bool run(int first, int end, int k, const BasicMatrixView<T> &X, const double *p_nk, int ld,
+                    const double *mu_rows, double *scatter)
+    {
+        const int packed = M*(M+1)/2;
+        double scratch[M];
+        double difference[M];
+        double weighted[M];
+        for (int data_point = first; data_point < end; data_point++)
+        {
+            const double *x = X.row(data_point, scratch);
+            for (int gaussian = 0; gaussian < k; gaussian++)
+            {
+                double pk = exp(p_nk[(std::size_t)gaussian*ld + data_point]);
+                const double *mu = mu_rows + gaussian*M;
+                double *s = scatter + (std::size_t)gaussian*packed;
+                for (int dim = 0; dim < M; dim++)
+                {
+                    difference[dim] = x[dim] - mu[dim];
+                    weighted[dim] = pk*difference[dim];
+                }
+                int p = 0;
+                for (int j = 0; j < M; j++)
+                    for (int i = 0; i <= j; i++)
+                        s[p++] += difference[j]*weighted[i];
+            }
+        }
+        return true;
+    }
+};
+
+/*! \brief fixed-dimension gaussmix_pdf: log density of x under N(mu, sigma)
+*/
+template<int M>
+struct PdfFixed
+{
+    static double run(const double *x, const Matrix &sigma_matrix, const double *mu)
+    {
+        SmallCholesky<M> factor((SmallMatrix<M>(sigma_matrix)));
+        return -0.5 * ( M*log(2 * M_PI) + factor.logdet() ) + (-0.5 * factor.mahalanobis(x, mu));
+    }
+};
 
 /******************************************************************************************
  *                             IMPLEMENTATION OF PRIVATE FUNCTIONS
@@ -248,155 +434,154 @@ double * matrixToRaw(const Matrix & X);
 @param n number of data points
 @param m dimensionality of data
 @param k number of clusters
-@param X data
+@param X view of data (n x m), double or float
 @param p_nk_matrix matrix generated by the caller of EM that holds the pnk's calculated
 @param sigma_matrix vector of matrix pointers generated by the caller of EM that holds the sigmas calculated
 @param mu_matrix matrix of mean vectors generated by caller
 @param Pk_vec vector generated by the caller of EM that holds the Pk's calculated
 */
-double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const std::vector<Matrix *> &sigma_matrix,
+template<typename T>
+double estep(int n, int m, int k, const BasicMatrixView<T> &X,  Matrix &p_nk_matrix, const std::vector<Matrix *> &sigma_matrix,
                     const Matrix &mu_matrix, const std::vector<double> & Pk_vec)
 {
     //initialize likelihood
     double likelihood = 0.0;
 
 #ifndef OPENCL    /* non-OpenCL variant */
-    //initialize variables
-    std::vector<Matrix*> sigma_inverses;
-    std::vector<double> determinants;
-    for (int gauss = 0; gauss < k; gauss++)
-    {
-        Matrix *sigma_inv = sigma_matrix[gauss]->inv();
-        sigma_inverses.push_back(sigma_inv);
-
-        double determinant = sigma_matrix[gauss]->det();
-        determinants.push_back(determinant);
-    }
-
-    //for each data point in n
-    for (int data_point = 0; data_point < n; data_point++)
+    //small dimensions use the fixed-size kernels; everything else takes the general path
+    if (!dispatchSmallMatrix<EstepFixed>(m, likelihood, n, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pk_vec))
     {
-        //initialize the x matrix, which holds the data passed in from double *X
-        Matrix x(1,m);
-        
-        //initialize the P_xn to zero to start
-        double P_xn = 0.0;
-
-        //for each dimension
-        for (int dim = 0; dim < m; dim++)
-        {    //put the data stored in the double* in the x matrix you just created
-            x.update( X[m*data_point + dim],0,dim );
-        }
-
-        //z_max is the maximum cluster weighted density for the data point under any gaussian
-        double z_max = 0.0;
-        bool z_max_assigned = false;
-
+        //factor all covariances at once: the factors give the log normalizers, and their inverses
+        //whiten whole blocks of (x - mu), so the mahalanobis distances are a triangular matrix multiply per block
+        CholeskyBatch factors(sigma_matrix);
+        const double *log_norm_factors = factors.logNormalizers();
+
+        //contiguous copy of the means, one aligned (padded) row per gaussian
+        int mu_ld = paddedLeadingDimension(m);
+        AlignedVector<double> mu_rows(k*mu_ld, 0.0);
+        for (int gauss = 0; gauss < k; gauss++)
+            for (int dim = 0; dim < m; dim++)
+                mu_rows[gauss*mu_ld + dim] = mu_matrix.getValue(gauss,dim);
+
+        //log of the cluster weights
+        std::vector<double> log_Pks(k);
+        for (int gauss = 0; gauss < k; gauss++)
+            log_Pks[gauss] = log(Pk_vec[gauss]);
+
+        //p_nk_matrix is column-major, one column per gaussian
+        double *p_nk = p_nk_matrix.getArray();
+        int ld = p_nk_matrix.rowCount();
+
+        //tile the work: when the whiteners of all k gaussians don't fit in cache, a tile of gaussians is
+        //run over a tile of several point blocks before moving on to the next, so each whitener is
+        //reused for many points while it is cache resident. The log of each point's total density is
+        //built up across the gaussian tiles with an online log-sum-exp.
+        std::size_t factor_bytes = std::max<std::size_t>(1, (std::size_t)factors.leadingDimension()*m*sizeof(double));
+        int gauss_tile = (int)std::max<std::size_t>(1, std::min<std::size_t>(k, ESTEP_TILE_BYTES/factor_bytes));
+        int tile_blocks = (gauss_tile < k) ? ESTEP_TILE_BLOCKS : 1;
+
+        //blocks of points are shared out among the threads (a tile at a time), whatever k is;
+        //each block keeps its own likelihood
+        int num_blocks = (n + ESTEP_BLOCK_SIZE - 1)/ESTEP_BLOCK_SIZE;
+        int num_tiles = (num_blocks + tile_blocks - 1)/tile_blocks;
+        std::vector<double> block_likelihood(num_blocks, 0.0);
 #ifdef _OPENMP
-        #pragma omp parallel for
+        #pragma omp parallel
 #endif /* _OPENMP */
-        for (int gaussian = 0; gaussian < k; ++gaussian)
-        { //initialize the row representation of the mu matrix
-            Matrix mu_matrix_row(1,m);
-            
-            //for each dimension
-            for (int dim = 0; dim < m; dim++)
-            { //fill in that matrix
-                double temp = mu_matrix.getValue(gaussian,dim);
-                mu_matrix_row.update(temp,0,dim);
-            }
-
-            //(x - mu)
-            Matrix* difference_row = x.subtract(mu_matrix_row);
-            if (DEBUG)
-                difference_row->print();
-
-            //transpose(x - mu)
-            Matrix difference_column(m,1);
-            for (int i = 0; i < m; i++)
-            {    // fill it in
-                difference_column.update( difference_row->getValue(0,i), i, 0 );
-            }
-
-            //transpose(x - mu) * inv(sigma)
-            Matrix* term1 = sigma_inverses[gaussian]->dot( difference_column );
-            if (DEBUG)
-            {
-                std::cout << "sigma_inv dot difference_column" << std::endl;
-                term1->print();
-            }
-            
-            //transpose(x - mu) * inv(sigma) * (x - mu)
-            Matrix *term2 = difference_row->dot(*term1);
-            if (DEBUG)
-            {
-                std::cout << "term2" << std::endl;
-                term2->print();
-            }
-
-            //create a double to represent term2, since it's a scalar
-            double term2_d = term2->getValue(0,0);
-            if( DEBUG )
-                printf("Datapoint: %d  Gauss: %d  Term2: %f\n", data_point, gaussian, term2_d);
-
-            // log norm factor is the normalization constant for the density functions
-            double log_norm_factor = -0.5*( m*log(2.0*M_PI) + log(determinants[gaussian]) );
-
-            //log density is the log of the density function for the kth gaussian evaluated on the nth data point
-            double log_density = log_norm_factor + (-0.5*term2_d);
-
-            //temp1 is the cluster weight for the current gaussian
-            double temp1 = Pk_vec[gaussian];
-
-            //temp2 is the log of the cluster weight for the current gaussian
-            double temp2 = log(temp1);
-
-            //current z is the log of the density function times the cluster weight
-            double current_z = temp2 + log_density;
+        {
+            //per-thread space: a block of points (column-major), its whitened copy, the distances to one
+            //gaussian, the log cluster weighted densities of the block under a tile of gaussians (a row per
+            //point) and the running log-sum-exp of every point of the tile
+            int tile_points = tile_blocks*ESTEP_BLOCK_SIZE;
+            std::vector<double> points((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> work((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> distances(ESTEP_BLOCK_SIZE);
+            std::vector<double> z((std::size_t)ESTEP_BLOCK_SIZE*gauss_tile);
+            std::vector<double> running_max(tile_points);
+            std::vector<double> running_sum(tile_points);
 
-            //assign current_z
 #ifdef _OPENMP
-            # pragma omp critical(z_max)
+            #pragma omp for schedule(static)
 #endif /* _OPENMP */
-            if ((z_max_assigned == false) || current_z > z_max)
+            for (int tile = 0; tile < num_tiles; tile++)
             {
-                z_max = current_z;
-                z_max_assigned = true;
-            }
+                int first_block = tile*tile_blocks;
+                int end_block = std::min(num_blocks, first_block + tile_blocks);
+                int tile_first = first_block*ESTEP_BLOCK_SIZE;
+                std::fill(running_max.begin(), running_max.end(), -std::numeric_limits<double>::infinity());
+                std::fill(running_sum.begin(), running_sum.end(), 0.0);
 
-            //calculate p_nk = density * Pk / weight
-            p_nk_matrix.update(current_z, data_point,gaussian);
-            if( DEBUG )
-            {
-                std::cout << "p_nk_matrix" << std::endl;
-                p_nk_matrix.print();
-            }
+                for (int first_gauss = 0; first_gauss < k; first_gauss += gauss_tile)
+                {
+                    int tile_k = std::min(gauss_tile, k - first_gauss);
+                    for (int block = first_block; block < end_block; block++)
+                    {
+                        int first = block*ESTEP_BLOCK_SIZE;
+                        int count = std::min(ESTEP_BLOCK_SIZE, n - first);
+                        X.copyRowBlock(first, count, &points[0], count);
+
+                        for (int t = 0; t < tile_k; t++)
+                        {
+                            int gaussian = first_gauss + t;
+
+                            //transpose(x - mu) * inv(sigma) * (x - mu) for every point of the block at once
+                            factors.mahalanobisBlock(gaussian, count, &points[0], count, &mu_rows[gaussian*mu_ld],
+                                                     &work[0], &distances[0]);
+
+                            //log of the density function for the kth gaussian evaluated on each data point,
+                            //times the cluster weight (normalized once every tile of gaussians is in)
+                            double *p_nk_g = p_nk + (std::size_t)gaussian*ld + first;
+                            for (int i = 0; i < count; i++)
+                            {
+                                double current_z = log_Pks[gaussian] + log_norm_factors[gaussian] + (-0.5*distances[i]);
+                                z[(std::size_t)i*tile_k + t] = current_z;
+                                p_nk_g[i] = current_z;
+                            }
+                        } // end gaussian
+
+                        for (int i = 0; i < count; i++)
+                            logSumExpMerge(tile_k, &z[(std::size_t)i*tile_k],
+                                           running_max[first - tile_first + i], running_sum[first - tile_first + i]);
+                    } // end block
+                } // end gaussian tile
+
+                for (int block = first_block; block < end_block; block++)
+                {
+                    int first = block*ESTEP_BLOCK_SIZE;
+                    int count = std::min(ESTEP_BLOCK_SIZE, n - first);
 
-#ifdef _OPENMP
-            # pragma omp critical(sigma_inv_tracking)
-#endif /* _OPENMP */
-            delete difference_row;
-            delete term1;
-            delete term2;
-        } // end gaussian 
-
-        //calculate the P_xn
-        for (int gaussian = 0; gaussian < k; gaussian++)
-            P_xn += exp( p_nk_matrix.getValue(data_point, gaussian) - z_max );
-
-        //log of total density for data point
-        double tempa = log(P_xn);
-        double log_P_xn = tempa + z_max;
-
-        //normalize the probabilities per cluster for data point
-        for (int gaussian = 0; gaussian < k; gaussian++)
-            p_nk_matrix.update( p_nk_matrix.getValue(data_point,gaussian)-log_P_xn, data_point,gaussian );
-        
-        //calculate the likelihood of this model
-        likelihood += log_P_xn;
-        if (DEBUG)
+                    //log of total density for each data point
+                    double *log_P_xn = &distances[0];
+                    double partial = 0.0;
+                    for (int i = 0; i < count; i++)
+                    {
+                        int r = first - tile_first + i;
+                        log_P_xn[i] = log(running_sum[r]) + running_max[r];
+                        partial += log_P_xn[i];
+                    }
+                    block_likelihood[block] = partial;
+
+                    //log p_nk = log(density * Pk / weight)
+                    for (int gaussian = 0; gaussian < k; gaussian++)
+                    {
+                        double *p_nk_g = p_nk + (std::size_t)gaussian*ld + first;
+                        for (int i = 0; i < count; i++)
+                            p_nk_g[i] -= log_P_xn[i];
+                    }
+                } // end block
+            } // end tile
+        }
+
+        //calculate the likelihood of this model, adding the blocks in order so the sum is reproducible
+        for (int block = 0; block < num_blocks; block++)
+            likelihood += block_likelihood[block];
+        if( DEBUG )
+        {
+            std::cout << "p_nk_matrix" << std::endl;
+            p_nk_matrix.print();
             std::cout << "The likelihood for this iteration is " << likelihood << std::endl;
-    } // end data_point
+        }
+    }
 
 #ifdef UseMPI
     // Now reduce the likelihood over all data points:
@@ -407,9 +592,6 @@ double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const s
     likelihood = totalLikelihood;
 #endif /* UseMPI */
 
-    for (int i = 0; i < k; i++)
-        delete sigma_inverses[i];
-
 #else    /* do OpenCL stuff */
     if( !isProgBuilt )
     {
@@ -491,8 +673,9 @@ double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const s
         0, sizeof(float)*(n*m), 0, 0, 0, &clerr);
     if(clerr != CL_SUCCESS)
         throw std::runtime_error("failed to map data points");
-    for( int i=0; i<(n*m); ++i )
-        pMapX[i] = (float)X[i];
+    for( int i=0; i<n; ++i )
+        for( int j=0; j<m; ++j )
+            pMapX[i*m+j] = (float)X.getValue(i,j);
     clerr = clEnqueueUnmapMemObject(commands, cl_X, pMapX, 0, 0, 0);
 
     // p_nk buffer- init and copy to dev
@@ -529,7 +712,7 @@ double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const s
 
         Matrix* pMat = sigma_matrix[ gMatIdx ];    // get cov
         pMapDets[ gMatIdx ] = (float)pMat->det();    // ... save det(cov)
-        Matrix* pMatInv = pMat->inv();    // ... save inv(cov)
+        Matrix pMatInv = pMat->inv();    // ... save inv(cov)
         //flatten mat inv to 1-D array
         for( int rIdx=0; rIdx<m; ++rIdx )
         {
@@ -538,12 +721,9 @@ double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const s
             for( int cIdx=0; cIdx<m; ++cIdx )
             {
                 int idx = (gMatIdx * m*m) + (cIdx*m + rIdx);
-                pMapSigmaInvs[idx] = (float)pMatInv->getValue(rIdx,cIdx);
+                pMapSigmaInvs[idx] = (float)pMatInv.getValue(rIdx,cIdx);
             }
         }
-
-        // the inv() return a heap object, so free it
-        delete pMatInv;
     }
 
     clerr = clEnqueueUnmapMemObject(commands, cl_sigma_invs, pMapSigmaInvs, 0, 0, 0);
@@ -633,66 +813,142 @@ double estep(int n, int m, int k, const double *X,  Matrix &p_nk_matrix, const s
     return likelihood;
 }
 
-/*! \brief mstep is the function that approximates the mu, sigma and P(k) paramters for a given Gaussian fit.
+/*! \brief estep for the diagonal, spherical and tied covariance types: computes the log p_nk's of every
+*   data point and returns the log likelihood. A MixtureScorer scores each block of points under all k
+*   gaussians at once, so diagonal and spherical models cost O(n*k*m) with no factorizations at all, and
+*   a tied model whitens each block once with its single factor.
 *
 @param n number of data points
 @param m dimensionality of data
 @param k number of clusters
-@param X data
+@param X view of data (n x m), double or float
 @param p_nk_matrix matrix generated by the caller of EM that holds the pnk's calculated
 @param sigma_matrix vector of matrix pointers generated by the caller of EM that holds the sigmas calculated
-@param mu_matrix  matrix of mean vectors generated by caller
+@param mu_matrix matrix of mean vectors generated by caller
 @param Pk_vec vector generated by the caller of EM that holds the Pk's calculated
+@param covariance structure of the covariances
 */
-
-bool mstep(int n, int m, int k, const double *X, Matrix &p_nk_matrix, std::vector<Matrix *> &sigma_matrix,
-                Matrix &mu_matrix, std::vector<double> & Pk_vec)
+template<typename T>
+double estep_structured(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix,
+                    const std::vector<Matrix *> &sigma_matrix, const Matrix &mu_matrix, const std::vector<double> &Pk_vec,
+                    gaussmix::CovarianceType covariance)
 {
-    // Update Pk_vec and mu_matrix
-    int gaussian = 0;
+    gaussmix::MixtureScorer scorer(covariance, sigma_matrix, mu_matrix, Pk_vec);
+
+    //p_nk_matrix is column-major, one column per gaussian
+    double *p_nk = p_nk_matrix.getArray();
+    int ld = p_nk_matrix.rowCount();
+
+    //blocks of points are shared out among the threads; each block keeps its own likelihood
+    int num_blocks = (n + ESTEP_BLOCK_SIZE - 1)/ESTEP_BLOCK_SIZE;
+    std::vector<double> block_likelihood(num_blocks, 0.0);
 #ifdef _OPENMP
-    # pragma omp parallel for
+    #pragma omp parallel
 #endif /* _OPENMP */
-    for (gaussian = 0; gaussian < k; gaussian++)
     {
-        //initialize the mean and covariance matrices that hold the mstep approximations
-        Matrix mu_hat(1,m);
+        std::vector<double> points((std::size_t)ESTEP_BLOCK_SIZE*m);
+        std::vector<double> work((std::size_t)ESTEP_BLOCK_SIZE*m);
+        std::vector<double> distances(ESTEP_BLOCK_SIZE);
+        std::vector<double> z((std::size_t)ESTEP_BLOCK_SIZE*k);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int first = block*ESTEP_BLOCK_SIZE;
+            int count = std::min(ESTEP_BLOCK_SIZE, n - first);
+            X.copyRowBlock(first, count, &points[0], count);
+            scorer.logWeightedDensities(count, &points[0], &work[0], &distances[0], &z[0]);
+
+            //log p_nk = log(density * Pk / weight)
+            double partial = 0.0;
+            for (int i = 0; i < count; i++)
+            {
+                double *z_i = &z[(std::size_t)i*k];
+                partial += logNormalize(k, z_i);
+                for (int gaussian = 0; gaussian < k; gaussian++)
+                    p_nk[(std::size_t)gaussian*ld + first + i] = z_i[gaussian];
+            }
+            block_likelihood[block] = partial;
+        }
+    }
+
+    //add the blocks in order so the sum is reproducible
+    double likelihood = 0.0;
+    for (int block = 0; block < num_blocks; block++)
+        likelihood += block_likelihood[block];
+
+#ifdef UseMPI
+    double totalLikelihood;
+    MPI_Allreduce(&likelihood, &totalLikelihood, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    likelihood = totalLikelihood;
+#endif /* UseMPI */
 
-        //initialize the normalization factor - this will be the sum of the densities for each data point for the current gaussian
-        double norm_factor = 0;
+    return likelihood;
+}
 
-        //initialize the array of doubles of length m that represents the data with some modification
-        double x[m];
-        //do the mu calculation point by point
+/*! \brief first half of every mstep: new cluster weights Pk_vec and means mu_matrix, reduced over all
+*   the MPI nodes and scaled. The points are shared out among the threads whatever k is.
+*
+@param n number of data points
+@param m dimensionality of data
+@param k number of clusters
+@param X view of data (n x m), double or float
+@param p_nk_matrix the log p_nk's from estep
+@param[out] mu_matrix the k new means
+@param[out] Pk_vec the k new cluster weights
+@param[out] unscaled_Pk_vec the k sums of p_nk over all points (on all nodes), for scaling the covariances
+*/
+template<typename T>
+void mstep_weights_and_means(int n, int m, int k, const BasicMatrixView<T> &X, const Matrix &p_nk_matrix,
+                Matrix &mu_matrix, std::vector<double> &Pk_vec, double unscaled_Pk_vec[])
+{
+    //p_nk_matrix is column-major, one column per gaussian
+    const double *p_nk = p_nk_matrix.getArray();
+    int ld = p_nk_matrix.rowCount();
+
+    // Update Pk_vec and mu_matrix. The points are shared out among the threads whatever k is: each
+    // thread sums its own points into a private accumulator (k weights, then k rows of m weighted
+    // sums), and the accumulators are then combined pairwise.
+    std::vector<std::vector<double> > partial_sums(accumulatorCount(), std::vector<double>((std::size_t)k*(m+1), 0.0));
+#ifdef _OPENMP
+    # pragma omp parallel
+#endif /* _OPENMP */
+    {
+        std::vector<double> &sums = partial_sums[accumulatorIndex()];
+        double scratch[m];
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
         for (int data_point = 0; data_point < n; data_point++)
         {
-            // No need to calculate this multiple times
-            double p_nk_local = p_nk_matrix.getValue(data_point,gaussian);
-            double exp_p_nk = exp(p_nk_local);
-            for (int dim = 0; dim < m; dim++)
+            const double *x_row = X.row(data_point, scratch);
+            for (int gaussian = 0; gaussian < k; gaussian++)
             {
-                x[dim] = X[m*data_point + dim]* exp_p_nk;
-            }
+                // No need to calculate this multiple times
+                double exp_p_nk = exp(p_nk[(std::size_t)gaussian*ld + data_point]);
 
-            //sum up all the individual mu calculations
-            mu_hat.add(x, m, 0);
+                //the normalization factor is the sum of the densities for each data point for the gaussian
+                sums[gaussian] += exp_p_nk;
 
-            //calculate the normalization factor
-            norm_factor += exp_p_nk;
+                //sum up all the individual mu calculations
+                weightedAccumulate(m, exp_p_nk, x_row, &sums[k + (std::size_t)gaussian*m]);
+            }
         }
-        Pk_vec[gaussian] = norm_factor;
+    }
+    treeReduce(partial_sums);
+
+    for (int gaussian = 0; gaussian < k; gaussian++)
+    {
+        Pk_vec[gaussian] = partial_sums[0][gaussian];
         //fill in the mu hat matrix with your new mu calculations, adjusted by the normalization factor
         // Update mu_hat and mu_matrix.  Scale mu_matrix if and only if not using MPI.
         for (int dim = 0; dim < m; dim++)
-        {
-            mu_matrix.update(mu_hat.getValue(0,dim),gaussian,dim);
-        }
-    } // parallel for loop over gaussians
+            mu_matrix.update(partial_sums[0][k + (std::size_t)gaussian*m + dim],gaussian,dim);
+    }
 
     // Reduce and scale PK and mu
-
-    // Temporary space for reduced Pk_vec - also used in calculation of sigma
-    double unscaled_Pk_vec[k];
     double global_scale=0.0;
 
     {
@@ -744,136 +1000,131 @@ bool mstep(int n, int m, int k, const double *X, Matrix &p_nk_matrix, std::vecto
                 mu_matrix.update(mu_matrix.getValue(gaussian,dim) / unscaled_Pk_vec[gaussian],gaussian,dim);
 #endif /* UseMPI */
     }
-    // Using new Pk_vec and mu_matrix, calculate updated sigma
-    int successflag = 0;
+}
+
+/*! \brief mstep is the function that approximates the mu, sigma and P(k) paramters for a given Gaussian fit.
+*
+@param n number of data points
+@param m dimensionality of data
+@param k number of clusters
+@param X view of data (n x m), double or float
+@param p_nk_matrix matrix generated by the caller of EM that holds the pnk's calculated
+@param sigma_matrix vector of matrix pointers generated by the caller of EM that holds the sigmas calculated
+@param mu_matrix  matrix of mean vectors generated by caller
+@param Pk_vec vector generated by the caller of EM that holds the Pk's calculated
+*/
+template<typename T>
+bool mstep(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, std::vector<Matrix *> &sigma_matrix,
+                Matrix &mu_matrix, std::vector<double> & Pk_vec)
+{
+    //p_nk_matrix is column-major, one column per gaussian
+    const double *p_nk = p_nk_matrix.getArray();
+    int ld = p_nk_matrix.rowCount();
+
+    // Update, reduce and scale Pk_vec and mu_matrix. Keep the reduced, unscaled Pk_vec for sigma
+    double unscaled_Pk_vec[k];
+    mstep_weights_and_means(n, m, k, X, p_nk_matrix, mu_matrix, Pk_vec, unscaled_Pk_vec);
+
+    // Using new Pk_vec and mu_matrix, calculate updated sigma. The weighted scatter of every gaussian
+    // about its new mean is accumulated like the means: a private accumulator of k packed m x m
+    // matrices (SymmetricMatrix layout) per thread over its share of the points, combined pairwise.
+    std::size_t packed = SymmetricMatrix::packedLength(m);
+    std::vector<double> mu_rows((std::size_t)k*m);
+    for (int gaussian = 0; gaussian < k; gaussian++)
+        for (int dim = 0; dim < m; dim++)
+            mu_rows[(std::size_t)gaussian*m + dim] = mu_matrix.getValue(gaussian,dim);
+
+    std::vector<std::vector<double> > partial_scatter(accumulatorCount(), std::vector<double>(k*packed, 0.0));
 #ifdef _OPENMP
-    # pragma omp parallel for
+    # pragma omp parallel
 #endif /* _OPENMP */
-    for (gaussian = 0; gaussian < k; gaussian++)
     {
-        // Check success flag
+        //this thread's (contiguous) share of the points
+        int thread = accumulatorIndex();
+        int num_threads = 1;
 #ifdef _OPENMP
-        #pragma omp flush(successflag)
+        num_threads = omp_get_num_threads();
 #endif /* _OPENMP */
-        if (successflag == 0)
-        {
-            Matrix sigma_hat(m,m);
+        int first = (int)(((long long)n*thread)/num_threads);
+        int end = (int)(((long long)n*(thread+1))/num_threads);
+        double *scatter = &partial_scatter[thread][0];
 
-            //calculate the new covariances, sigma_hat
-            for (int data_point = 0; data_point < n; data_point++)
+        //small dimensions use the fixed-size kernels; everything else takes the general path
+        bool accumulated = false;
+        if (!dispatchSmallMatrix<MstepScatterFixed>(m, accumulated, first, end, k, X, p_nk, ld, &mu_rows[0], scatter))
+        {
+            //sigma_hat += sum of pk * (x - mu)*transpose(x - mu), a block of points at a time: with each
+            //centered point scaled by sqrt(pk), a block's sum is one symmetric rank-k update (DSYRK) per
+            //gaussian, which is folded into the gaussian's packed accumulator
+            std::vector<double> block_scatter((std::size_t)m*m);
+            std::vector<double> points((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> centered((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> root_pk(ESTEP_BLOCK_SIZE);
+            for (int block_first = first; block_first < end; block_first += ESTEP_BLOCK_SIZE)
             {
-                const double *x = &(X[m*data_point]);
-
-                //magical kronecker tensor product calculation
-                double pk = exp(p_nk_matrix.getValue(data_point,gaussian));
-                for (int i = 0; i < m; i++)
+                int count = std::min(ESTEP_BLOCK_SIZE, end - block_first);
+                X.copyRowBlock(block_first, count, &points[0], count);
+                for (int gaussian = 0; gaussian < k; gaussian++)
                 {
-                    for (int j = 0; j < m; j++)
+                    //sqrt(exp(log p_nk))
+                    const double *log_pk = p_nk + (std::size_t)gaussian*ld + block_first;
+                    for (int i = 0; i < count; i++)
+                        root_pk[i] = exp(0.5*log_pk[i]);
+
+                    for (int dim = 0; dim < m; dim++)
                     {
-                        double temp1 = (x[i]-mu_matrix.getValue(gaussian,i)) *
-                            (x[j]-mu_matrix.getValue(gaussian,j)) *
-                            pk;
-                        sigma_hat.update(sigma_hat.getValue(i,j) + temp1, i, j);
+                        const double *x = &points[(std::size_t)dim*count];
+                        double *c = &centered[(std::size_t)dim*count];
+                        double mu = mu_rows[(std::size_t)gaussian*m + dim];
+                        for (int i = 0; i < count; i++)
+                            c[i] = (x[i] - mu)*root_pk[i];
                     }
-                }
-            }//end data point
-
-            //rest of the sigma calculation, adjusted by the normalization factor
-            for (int i = 0; i < m; i++)
-            {
-                for (int j = 0; j < m; j++)
-                {
-                    sigma_hat.update(sigma_hat.getValue(i,j)/(2*Pk_vec[gaussian]),i,j);
-                }
-            }
-            
-            //you can't have a negative determinant - if somehow you do, mstep throws up its hands and EM will terminate
-            double determinant;
-            {
-                determinant = sigma_hat.det();
-            }
-            if (determinant < 0)
-            {
-                successflag = 1;
-#ifdef _OPENMP
-            #pragma omp flush(successflag)
-#endif /* _OPENMP */
-            }
-
-            //assign sigma_hat to sigma_matrix[gaussian]
-            for (int i = 0; i < m; i++)
-            {
-                for (int j = 0; j < m; j++)
-                {
-                    sigma_matrix[gaussian]->update(sigma_hat.getValue(i,j), i, j);
+                    cblas_dsyrk(CblasColMajor, CblasUpper, CblasTrans, m, count, 1.0, &centered[0], count,
+                                0.0, &block_scatter[0], m);
+                    SymmetricMatrix::addUpper(m, &block_scatter[0], m, scatter + (std::size_t)gaussian*packed);
                 }
             }
+        }
+    }
+    treeReduce(partial_scatter);
+    std::vector<double> &sigma_hat = partial_scatter[0];
 
-        } // end if successflag == true
+    // Reduce sigma_hat (packed)
 #ifdef UseMPI
-#ifndef _OPENMP
-        // MPI Collectives don't work well inside OpenMP parallel regions.
-        // Move this outside the loop.
-        {
-            int global_successflag;
-            
-            MPI_Allreduce(&successflag,&global_successflag,1,MPI_INT, MPI_LOR, MPI_COMM_WORLD);
-            if (DEBUG)
-                std::cout << "global_successflag: "<<global_successflag<<std::endl;
-            successflag = global_successflag;
-        }        
-#endif /* _OPEN_MP */
+    MPI_Allreduce(MPI_IN_PLACE, &sigma_hat[0], (int)(k*packed), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 #endif /* UseMPI */
 
-    } //end gaussian
-#ifdef UseMPI
+    //a covariance must be positive definite - if it isn't, the cholesky factorization fails,
+    //mstep throws up its hands and EM will terminate. Every node has the same reduced sigma_hat,
+    //so they all reach the same verdict.
+    int successflag = 0;
 #ifdef _OPENMP
-    // Moved outside the parallel loop if using OpenMP and MPI both
-    {
-        int global_successflag;
-
-        MPI_Allreduce(&successflag,&global_successflag,1,MPI_INT, MPI_LOR, MPI_COMM_WORLD);
-        if (DEBUG)
-            std::cout << "global_successflag: "<<global_successflag<<std::endl;
-        successflag = global_successflag;
-    }        
+    # pragma omp parallel for reduction(+:successflag)
 #endif /* _OPENMP */
-#endif /* UseMPI */
-
-    // Reduce  and scale sigma
-#ifdef UseMPI
+    for (int gaussian = 0; gaussian < k; gaussian++)
     {
-        // MPI workspace
-        double global_work[k*m*m];
-        double local_work[k*m*m];
-
-        // Sigma
-        for (int gaussian=0; gaussian<k; gaussian++)
-        {
-            for (int i = 0; i < m; i++)
+        //rest of the sigma calculation, adjusted by the normalization factor, unpacked into sigma_matrix[gaussian]
+        const double *packed_sigma = &sigma_hat[gaussian*packed];
+        Matrix &sigma = *sigma_matrix[gaussian];
+        double scale = 1.0/(2*Pk_vec[gaussian]);
+        std::size_t p = 0;
+        for (int j = 0; j < m; j++)
+            for (int i = 0; i <= j; i++)
             {
-                for (int j = 0; j < m; j++)
-                {
-                    local_work[gaussian*m*m+i*m+j] = sigma_matrix[gaussian]->getValue(i,j);
-                }
+                double value = packed_sigma[p++]*scale/unscaled_Pk_vec[gaussian];
+                sigma.update(value, i, j);
+                sigma.update(value, j, i);
             }
 
+        try
+        {
+            Cholesky factor(sigma);
         }
-        // Reduce
-        MPI_Allreduce(local_work,global_work,k*m*m,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-        // Restore and normalize reduced sigma
-        for (int gaussian=0; gaussian<k; gaussian++)
-            for (int i = 0; i < m; i++)
-                for (int j = 0; j < m; j++)
-                    sigma_matrix[gaussian]->update(global_work[gaussian*m*m+i*m+j] / unscaled_Pk_vec[gaussian], i, j);
-    }
-#else
-    // Restore and normalize reduced sigma
-    for (int gaussian=0; gaussian<k; gaussian++)
-        for (int i = 0; i < m; i++)
-            for (int j = 0; j < m; j++)
-                sigma_matrix[gaussian]->update( sigma_matrix[gaussian]->getValue(i,j)/ unscaled_Pk_vec[gaussian], i, j );
-#endif /* UseMPI */
+        catch (LapackError &)
+        {
+            successflag += 1;
+        }
+    } //end gaussian
 
     if (DEBUG)
     {
@@ -916,36 +1167,222 @@ bool mstep(int n, int m, int k, const double *X, Matrix &p_nk_matrix, std::vecto
     return !successflag;
 }
 
-
-
-/*******************************************************************************************
- *                         IMPLEMENTATIONS OF PUBLIC FUNCTIONS
- ******************************************************************************************/
-
-
-int gaussmix::gaussmix_adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
-        Matrix &mu_matrix, std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
-        Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks)
+/*! \brief mstep for the diagonal, spherical and tied covariance types. The weights and means are updated
+*   as for full covariances, and so is the scale of the covariances: each is the projection of the
+*   covariances mstep would estimate onto the structure (see constrainCovariances). That is the diagonal of
+*   a gaussian's weighted scatter, scaled as in mstep (diagonal), the mean of that diagonal (spherical), or
+*   the average of the gaussians' scaled scatters weighted by the new Pks (tied). Diagonal and spherical
+*   variances are O(n*k*m) to compute and are floored at VARIANCE_FLOOR.
+*
+@param n number of data points
+@param m dimensionality of data
+@param k number of clusters
+@param X view of data (n x m), double or float
+@param p_nk_matrix matrix generated by the caller of EM that holds the pnk's calculated
+@param sigma_matrix vector of matrix pointers generated by the caller of EM that holds the sigmas calculated
+@param mu_matrix  matrix of mean vectors generated by caller
+@param Pk_vec vector generated by the caller of EM that holds the Pk's calculated
+@param covariance structure of the covariances
+@return false if a covariance cannot be estimated (a gaussian lost all its weight, or the tied covariance is singular)
+*/
+template<typename T>
+bool mstep_structured(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix,
+                std::vector<Matrix *> &sigma_matrix, Matrix &mu_matrix, std::vector<double> &Pk_vec,
+                gaussmix::CovarianceType covariance)
 {
-    int result =  gaussmix::adapt(X,n,sigma_matrix,mu_matrix,Pks,adapted_sigma_matrix,adapted_mu_matrix,adapted_Pks);
+    //p_nk_matrix is column-major, one column per gaussian
+    const double *p_nk = p_nk_matrix.getArray();
+    int ld = p_nk_matrix.rowCount();
 
-    return result;
-}
-
-double* gaussmix::gaussmix_matrixToRaw(const Matrix & X)
-{
-    unsigned int rows = X.rowCount();
-    unsigned int cols = X.colCount();
+    double unscaled_Pk_vec[k];
+    mstep_weights_and_means(n, m, k, X, p_nk_matrix, mu_matrix, Pk_vec, unscaled_Pk_vec);
 
-    double* ptr = new double[rows * cols];
+    for (int gaussian = 0; gaussian < k; gaussian++)
+        if (!(unscaled_Pk_vec[gaussian] > 0.0))
+            return false;
 
-    for (unsigned int i = 0; i < rows; ++i)
-        for (unsigned int j = 0; j < cols; ++j)
-            ptr[i*cols + j] = X.getValue(i,j);
+    std::vector<double> mu_rows((std::size_t)k*m);
+    for (int gaussian = 0; gaussian < k; gaussian++)
+        for (int dim = 0; dim < m; dim++)
+            mu_rows[(std::size_t)gaussian*m + dim] = mu_matrix.getValue(gaussian,dim);
 
-    // returns pointer to heap allocated array
-    return ptr;
-}
+    if (covariance == gaussmix::COVARIANCE_TIED)
+    {
+        //one m x m accumulator (lower triangle) per thread: each block of points adds one DSYRK per gaussian
+        //of its points centered on the gaussian's mean and scaled by sqrt(pk). The gaussian's share is
+        //Pk times its covariance as mstep scales it, 1/(2*Pk*unscaled_Pk), so alpha is 1/(2*unscaled_Pk).
+        std::vector<std::vector<double> > partial_scatter(accumulatorCount(), std::vector<double>((std::size_t)m*m, 0.0));
+        int num_blocks = (n + ESTEP_BLOCK_SIZE - 1)/ESTEP_BLOCK_SIZE;
+#ifdef _OPENMP
+        # pragma omp parallel
+#endif /* _OPENMP */
+        {
+            double *scatter = &partial_scatter[accumulatorIndex()][0];
+            std::vector<double> points((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> centered((std::size_t)ESTEP_BLOCK_SIZE*m);
+            std::vector<double> root_pk(ESTEP_BLOCK_SIZE);
+#ifdef _OPENMP
+            # pragma omp for schedule(static)
+#endif /* _OPENMP */
+            for (int block = 0; block < num_blocks; block++)
+            {
+                int first = block*ESTEP_BLOCK_SIZE;
+                int count = std::min(ESTEP_BLOCK_SIZE, n - first);
+                X.copyRowBlock(first, count, &points[0], count);
+                for (int gaussian = 0; gaussian < k; gaussian++)
+                {
+                    const double *log_pk = p_nk + (std::size_t)gaussian*ld + first;
+                    for (int i = 0; i < count; i++)
+                        root_pk[i] = exp(0.5*log_pk[i]);
+
+                    for (int dim = 0; dim < m; dim++)
+                    {
+                        const double *x = &points[(std::size_t)dim*count];
+                        double *c = &centered[(std::size_t)dim*count];
+                        double mu = mu_rows[(std::size_t)gaussian*m + dim];
+                        for (int i = 0; i < count; i++)
+                            c[i] = (x[i] - mu)*root_pk[i];
+                    }
+                    cblas_dsyrk(CblasColMajor, CblasLower, CblasTrans, m, count, 0.5/unscaled_Pk_vec[gaussian],
+                                &centered[0], count, 1.0, scatter, m);
+                }
+            }
+        }
+        treeReduce(partial_scatter);
+        std::vector<double> &pooled = partial_scatter[0];
+#ifdef UseMPI
+        {
+            std::vector<double> global_work((std::size_t)m*m);
+            MPI_Allreduce(&pooled[0],&global_work[0],m*m,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+            pooled.swap(global_work);
+        }
+#endif /* UseMPI */
+
+        //the shared covariance goes in every gaussian's slot
+        for (int j = 0; j < m; j++)
+            for (int i = j; i < m; i++)
+            {
+                double value = pooled[(std::size_t)j*m + i];
+                for (int gaussian = 0; gaussian < k; gaussian++)
+                {
+                    sigma_matrix[gaussian]->update(value, i, j);
+                    sigma_matrix[gaussian]->update(value, j, i);
+                }
+            }
+
+        try
+        {
+            Cholesky factor(*sigma_matrix[0]);
+        }
+        catch (LapackError &)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    //diagonal and spherical: k rows of m weighted sums of squared deviations per thread
+    std::vector<std::vector<double> > partial_squares(accumulatorCount(), std::vector<double>((std::size_t)k*m, 0.0));
+#ifdef _OPENMP
+    # pragma omp parallel
+#endif /* _OPENMP */
+    {
+        std::vector<double> &squares = partial_squares[accumulatorIndex()];
+        double scratch[m];
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int data_point = 0; data_point < n; data_point++)
+        {
+            const double *x_row = X.row(data_point, scratch);
+            for (int gaussian = 0; gaussian < k; gaussian++)
+            {
+                double exp_p_nk = exp(p_nk[(std::size_t)gaussian*ld + data_point]);
+                const double *mu = &mu_rows[(std::size_t)gaussian*m];
+                double *square = &squares[(std::size_t)gaussian*m];
+                for (int dim = 0; dim < m; dim++)
+                {
+                    double diff = x_row[dim] - mu[dim];
+                    square[dim] += exp_p_nk*diff*diff;
+                }
+            }
+        }
+    }
+    treeReduce(partial_squares);
+    std::vector<double> &squares = partial_squares[0];
+#ifdef UseMPI
+    {
+        std::vector<double> global_work((std::size_t)k*m);
+        MPI_Allreduce(&squares[0],&global_work[0],k*m,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+        squares.swap(global_work);
+    }
+#endif /* UseMPI */
+
+    for (int gaussian = 0; gaussian < k; gaussian++)
+    {
+        double *variance = &squares[(std::size_t)gaussian*m];
+        if (covariance == gaussmix::COVARIANCE_SPHERICAL)
+        {
+            double mean_square = 0.0;
+            for (int dim = 0; dim < m; dim++)
+                mean_square += variance[dim];
+            mean_square /= m;
+            for (int dim = 0; dim < m; dim++)
+                variance[dim] = mean_square;
+        }
+
+        Matrix &sigma = *sigma_matrix[gaussian];
+        for (int j = 0; j < m; j++)
+        {
+            for (int i = 0; i < m; i++)
+                sigma.update(0.0, i, j);
+            double v = variance[j]/(2*Pk_vec[gaussian]*unscaled_Pk_vec[gaussian]);
+            sigma.update((v > VARIANCE_FLOOR) ? v : VARIANCE_FLOOR, j, j);
+        }
+    }
+
+    return true;
+}
+
+
+
+/*******************************************************************************************
+ *                         IMPLEMENTATIONS OF PUBLIC FUNCTIONS
+ ******************************************************************************************/
+
+
+int gaussmix::gaussmix_adapt(const MatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
+        Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks, CovarianceType covariance)
+{
+    int result =  gaussmix::adapt(X,n,sigma_matrix,mu_matrix,Pks,adapted_sigma_matrix,adapted_mu_matrix,adapted_Pks,covariance);
+
+    return result;
+}
+
+int gaussmix::gaussmix_adapt(const FloatMatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
+        Matrix &adapted_mu_matrix, std::vector<double> &adapted_Pks, CovarianceType covariance)
+{
+    int result =  gaussmix::adapt(X,n,sigma_matrix,mu_matrix,Pks,adapted_sigma_matrix,adapted_mu_matrix,adapted_Pks,covariance);
+
+    return result;
+}
+
+double* gaussmix::gaussmix_matrixToRaw(const Matrix & X)
+{
+    unsigned int rows = X.rowCount();
+    unsigned int cols = X.colCount();
+
+    double* ptr = new double[rows * cols];
+
+    for (unsigned int i = 0; i < rows; ++i)
+        for (unsigned int j = 0; j < cols; ++j)
+            ptr[i*cols + j] = X.getValue(i,j);
+
+    // returns pointer to heap allocated array
+    return ptr;
+}
 
 int* serializeIntVector(const std::vector<int> &vec)
 {
@@ -988,31 +1425,17 @@ int gaussmix::parse_line(char * buffer, Matrix & X, std::vector<int> & labels, i
     }
 
     if (strstr(buffer,":"))
-    { // we have svm format (labelled data)
-        char * plabel = strtok(buffer," ");
-        if(plabel)
-            sscanf(plabel,"%d",&(labels[row]));
-
-        if (errno != 0)
+    { // we have svm format (labelled data): indices absent from the line are 0
+        std::vector<int> columns;
+        std::vector<double> values;
+        if (parse_svm_line(buffer, m, labels[row], columns, values) != 0)
         {
             if (DEBUG)
-                std::cout << "Could not convert label at row " << row << ": " << strerror(errno) << std::endl;
+                std::cout << "Could not convert svm data at row " << row << std::endl;
             return GAUSSMIX_FILE_NOT_FOUND;
         }
-
-        // libsvm-style input (label 1:data_point_1 2:data_point_2 etc.)
-        for (cols = 0; cols < m; cols++)
-        {
-            strtok(NULL, ":");    // bump past position label
-            sscanf(strtok(NULL, " "), "%lf", &temp);
-            if (errno != 0)
-            {
-                if (DEBUG)
-                    std::cout << "Could not convert data at index " << row << " and " << cols << ": " << strerror(errno) << "temp is " << temp << std::endl;
-                return GAUSSMIX_FILE_NOT_FOUND;
-            }
-            X.update(temp,row,cols);
-        }
+        for (std::size_t e = 0; e < columns.size(); e++)
+            X.update(values[e],row,columns[e]);
     }
     else
     { // csv-style input (data_point_1,data_point_2, etc.)
@@ -1045,6 +1468,129 @@ int gaussmix::parse_line(char * buffer, Matrix & X, std::vector<int> & labels, i
     return 0;
 }
 
+/*! \brief parse_svm_line parse one libsvm-format line: "label index:value index:value ..."
+*
+* The indices (1-rel, at most m) may come in any order and need not all be present.
+@param buffer the line (not modified)
+@param m dimensionality of data
+@param[out] label the label
+@param[out] columns 0-rel columns of the values given, increasing
+@param[out] values the values, in the same order as columns
+@return 0 on success, GAUSSMIX_FILE_NOT_FOUND on a malformed line
+*/
+int parse_svm_line(char * buffer, int m, int & label, std::vector<int> & columns, std::vector<double> & values)
+{
+    char * end;
+    errno = 0;
+    label = (int)strtol(buffer, &end, 10);
+    if (end == buffer || errno != 0)
+        return gaussmix::GAUSSMIX_FILE_NOT_FOUND;
+    // tolerate labels written as reals, e.g. "1.0"
+    while (*end && !isspace(*end))
+        end++;
+
+    std::vector<std::pair<int, double> > entries;
+    char * p = end;
+    for (;;)
+    {
+        while (isspace(*p))
+            p++;
+        if (*p == 0)
+            break;
+
+        long index = strtol(p, &end, 10);
+        if (end == p || *end != ':' || index < 1 || index > m)
+            return gaussmix::GAUSSMIX_FILE_NOT_FOUND;
+        p = end + 1;
+
+        double value = strtod(p, &end);
+        if (end == p || errno != 0)
+            return gaussmix::GAUSSMIX_FILE_NOT_FOUND;
+        p = end;
+
+        entries.push_back(std::make_pair((int)index - 1, value));
+    }
+
+    std::sort(entries.begin(), entries.end());
+    columns.resize(entries.size());
+    values.resize(entries.size());
+    for (std::size_t e = 0; e < entries.size(); e++)
+    {
+        if (e > 0 && entries[e].first == entries[e-1].first)
+            return gaussmix::GAUSSMIX_FILE_NOT_FOUND;
+        columns[e] = entries[e].first;
+        values[e] = entries[e].second;
+    }
+    return 0;
+}
+
+int gaussmix::gaussmix_parse_sparse(char *file_name, int n, int m, SparseMatrix & X, int & localSamples, std::vector<int> & labels)
+{
+    // this node's block of lines: the same split as gaussmix_parse, which hands the file out
+    // from the last node to node 0 (node 0 gets what is left over)
+    int perNode = (n + totalNodes-1)/totalNodes;
+    localSamples = (myNode == 0) ? n - (totalNodes-1)*perNode : perNode;
+    int firstRow = (totalNodes-1-myNode)*perNode;
+
+    FILE *f = fopen(file_name, "r");
+    if( 0==f )
+        return GAUSSMIX_FILE_NOT_FOUND;
+
+    X = SparseMatrix(m);
+    X.reserve(localSamples, 0);
+    labels.assign(localSamples, 0);
+
+    // lines of sparse data can be long, so they are read whole rather than into a fixed buffer
+    char *line = 0;
+    size_t capacity = 0;
+    std::vector<int> columns;
+    std::vector<double> values;
+    std::vector<double> dense(m);
+    int condition = GAUSSMIX_SUCCESS;
+
+    for (int row = 0; row < firstRow + localSamples && condition == GAUSSMIX_SUCCESS; row++)
+    {
+        if (getline(&line, &capacity, f) < 0)
+        {
+            std::cout << "ERROR: Ran out of data on row " << row << std::endl;
+            condition = GAUSSMIX_FILE_NOT_FOUND;
+            break;
+        }
+        if (row < firstRow)
+            continue;
+
+        int localRow = row - firstRow;
+        if (strchr(line, ':'))
+        { // svm format
+            if (parse_svm_line(line, m, labels[localRow], columns, values) != 0)
+                condition = GAUSSMIX_FILE_NOT_FOUND;
+            else
+                X.appendRow((int)columns.size(), columns.empty() ? 0 : &columns[0], values.empty() ? 0 : &values[0]);
+        }
+        else
+        { // csv format: keep the non-zeros
+            char *p = line;
+            for (int col = 0; col < m && condition == GAUSSMIX_SUCCESS; col++)
+            {
+                char *end;
+                errno = 0;
+                dense[col] = strtod(p, &end);
+                if (end == p || errno != 0)
+                    condition = GAUSSMIX_FILE_NOT_FOUND;
+                p = (*end == ',') ? end + 1 : end;
+            }
+            if (condition == GAUSSMIX_SUCCESS)
+                X.appendDenseRow(&dense[0]);
+        }
+        if (condition != GAUSSMIX_SUCCESS)
+            std::cout << "ERROR: Could not parse line " << row << std::endl;
+    }
+
+    free(line);
+    fclose(f);
+    return condition;
+}
+
 int gaussmix::gaussmix_parse(char *file_name, int n, int m, Matrix & X, int & localSamples, std::vector<int> & labels )
 {
 #ifdef UseMPI
@@ -1214,94 +1760,389 @@ int gaussmix::gaussmix_parse(char *file_name, int n, int m, Matrix & X, int & lo
 }
 
 
-double gaussmix::gaussmix_pdf(int m, std::vector<double> X, Matrix &sigma_matrix,std::vector<double> &mu_vector)
+double gaussmix::gaussmix_pdf(int m, const std::vector<double> &X, const Matrix &sigma_matrix, const std::vector<double> &mu_vector)
 {
-    const double pi_fac = std::pow(2 * M_PI, m * 0.5);
+    return gaussmix::gaussmix_pdf(MatrixView(&X[0], 1, m, m, Matrix::ROW_MAJOR), 0, sigma_matrix, mu_vector);
+}
 
-    // set up our normalizing factor
-    double det = sigma_matrix.det();
-    double norm_fac = ( 1.0 / (pi_fac * std::pow(det, 0.5)));
+double gaussmix::gaussmix_pdf(const MatrixView &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector)
+{
+    return log_pdf(X, row, sigma_matrix, mu_vector);
+}
+
+double gaussmix::gaussmix_pdf(const FloatMatrixView &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector)
+{
+    return log_pdf(X, row, sigma_matrix, mu_vector);
+}
+
+template<typename T>
+double log_pdf(const BasicMatrixView<T> &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector)
+{
+    int m = X.colCount();
+
+    // small dimensions use the fixed-size kernel
+    double scratch[m];
+    double log_density;
+    if (dispatchSmallMatrix<PdfFixed>(m, log_density, X.row(row, scratch), sigma_matrix, &mu_vector[0]))
+        return log_density;
 
     // compute the difference of feature and mean vectors
     double meanDiff[m];
 
     for (int j = 0; j < m; j++)
-        meanDiff[j] = X[j] - mu_vector[j];
+        meanDiff[j] = X.getValue(row,j) - mu_vector[j];
 
-    // convert to row and column vector
-    Matrix meanDiffRowVec(meanDiff, 1, m, Matrix::ROW_MAJOR);
-    Matrix meanDiffColVec(meanDiff, m, 1, Matrix::COLUMN_MAJOR);
+    // factor the covariance: gives the normalizing factor and the inner product without an inverse
+    Cholesky factor = sigma_matrix.cholesky();
 
-    // get inverted covariance matrix
-    Matrix * inv = sigma_matrix.inv();
+    // set up our (log) normalizing factor
+    double log_norm_fac = -0.5 * ( m*log(2 * M_PI) + factor.logdet() );
 
     // get exp of inner product
-    // inv is mxm, rowvec is 1xm, colvec is mx1
-    Matrix * innerAsMatrix = meanDiffRowVec.dot( *(inv->dot(meanDiffColVec)) );
-    double exp_inner = -0.5 * innerAsMatrix->getValue(0,0);
-
+    double exp_inner = -0.5 * factor.mahalanobis(meanDiff);
 
     // roll in weighted sum
-    double result = log(norm_fac) +  exp_inner;
+    return log_norm_fac + exp_inner;
+}
 
-    delete inv;
-    delete innerAsMatrix;
+double gaussmix::gaussmix_pdf_mix(int m, int k, const std::vector<double> &X, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, CovarianceType covariance)
+{
+    return gaussmix::gaussmix_pdf_mix(MatrixView(&X[0], 1, m, m, Matrix::ROW_MAJOR), 0, k, sigma_matrix, mu_matrix, Pks,
+                                      covariance);
+}
 
-    return result;
+double gaussmix::gaussmix_pdf_mix(const MatrixView &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, CovarianceType covariance)
+{
+    return log_pdf_mix(X, row, k, sigma_matrix, mu_matrix, Pks, covariance);
 }
 
-double gaussmix::gaussmix_pdf_mix(int m, int k, std::vector<double> X, vector<Matrix*> &sigma_matrix,
-        Matrix &mu_matrix, std::vector<double> &Pks)
+double gaussmix::gaussmix_pdf_mix(const FloatMatrixView &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, CovarianceType covariance)
 {
-    double sum_probs = 0.0;
+    return log_pdf_mix(X, row, k, sigma_matrix, mu_matrix, Pks, covariance);
+}
 
-    for (int i = 0; i < k; i++)
+double gaussmix::gaussmix_pdf_mix(const MatrixView &X, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+        CovarianceType covariance)
+{
+    return log_pdf_mix_rows(X, k, sigma_matrix, mu_matrix, Pks, log_likelihoods, covariance);
+}
+
+double gaussmix::gaussmix_pdf_mix(const FloatMatrixView &X, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+        CovarianceType covariance)
+{
+    return log_pdf_mix_rows(X, k, sigma_matrix, mu_matrix, Pks, log_likelihoods, covariance);
+}
+
+double gaussmix::gaussmix_pdf_mix_sparse(const SparseMatrix &X, int row, int k, const Matrix &variance_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks)
+{
+    check_mixture_size(k, k, variance_matrix, mu_matrix, Pks);
+    return gaussmix::pdf_mix_sparse_diagonal(X, row, variance_matrix, mu_matrix, Pks);
+}
+
+double gaussmix::gaussmix_pdf_mix_factor(const MatrixView &X, int row, int k, const vector<Matrix*> &loading_matrix,
+        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks)
+{
+    check_mixture_size(k, (int)loading_matrix.size(), variance_matrix, mu_matrix, Pks);
+    double log_likelihood;
+    gaussmix::pdf_mix_factor_analyzers(X, row, 1, loading_matrix, variance_matrix, mu_matrix, Pks, &log_likelihood);
+    return log_likelihood;
+}
+
+double gaussmix::gaussmix_pdf_mix_factor(const FloatMatrixView &X, int row, int k, const vector<Matrix*> &loading_matrix,
+        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks)
+{
+    check_mixture_size(k, (int)loading_matrix.size(), variance_matrix, mu_matrix, Pks);
+    double log_likelihood;
+    gaussmix::pdf_mix_factor_analyzers(X, row, 1, loading_matrix, variance_matrix, mu_matrix, Pks, &log_likelihood);
+    return log_likelihood;
+}
+
+double gaussmix::gaussmix_pdf_mix_factor(const MatrixView &X, int k, const vector<Matrix*> &loading_matrix,
+        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks,
+        std::vector<double> &log_likelihoods)
+{
+    check_mixture_size(k, (int)loading_matrix.size(), variance_matrix, mu_matrix, Pks);
+    int n = X.rowCount();
+    log_likelihoods.resize(n);
+    if (n > 0)
+        gaussmix::pdf_mix_factor_analyzers(X, 0, n, loading_matrix, variance_matrix, mu_matrix, Pks, &log_likelihoods[0]);
+
+    double total = 0.0;
+    for (int p = 0; p < n; p++)
+        total += log_likelihoods[p];
+    return total;
+}
+
+double gaussmix::gaussmix_pdf_mix_factor(const FloatMatrixView &X, int k, const vector<Matrix*> &loading_matrix,
+        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks,
+        std::vector<double> &log_likelihoods)
+{
+    check_mixture_size(k, (int)loading_matrix.size(), variance_matrix, mu_matrix, Pks);
+    int n = X.rowCount();
+    log_likelihoods.resize(n);
+    if (n > 0)
+        gaussmix::pdf_mix_factor_analyzers(X, 0, n, loading_matrix, variance_matrix, mu_matrix, Pks, &log_likelihoods[0]);
+
+    double total = 0.0;
+    for (int p = 0; p < n; p++)
+        total += log_likelihoods[p];
+    return total;
+}
+
+/*! \brief check_mixture_size: throw SizeError unless a model given as per-component parameters has k
+*   components throughout (components is the number of per-component matrices the model holds)
+*/
+void check_mixture_size(int k, int components, const Matrix &variance_matrix, const Matrix &mu_matrix,
+        const std::vector<double> &Pks)
+{
+    if (k < 1 || components != k || (int)Pks.size() != k || mu_matrix.rowCount() != k || variance_matrix.rowCount() != k)
+        throw SizeError("Error: model does not have k components");
+}
+
+/*! \brief check_mixture_size: as above, for a model given as k covariance matrices (of any CovarianceType)
+*/
+void check_mixture_size(int k, const vector<Matrix*> &sigma_matrix, const Matrix &mu_matrix,
+        const std::vector<double> &Pks)
+{
+    if (k < 1 || (int)sigma_matrix.size() != k || (int)Pks.size() != k || mu_matrix.rowCount() != k)
+        throw SizeError("Error: model does not have k components");
+}
+
+template<typename T>
+double log_pdf_mix(const BasicMatrixView<T> &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, gaussmix::CovarianceType covariance)
+{
+    // z below holds one entry per component of the model
+    check_mixture_size(k, sigma_matrix, mu_matrix, Pks);
+
+    int m = X.colCount();
+
+    // factor the covariances (or invert the variances) up front, and score the point as a block of one
+    gaussmix::MixtureScorer scorer(covariance, sigma_matrix, mu_matrix, Pks);
+
+    double point[m];
+    double work[m];
+    double distance;
+    double z[k];
+    X.copyRowBlock(row, 1, point, 1);
+    scorer.logWeightedDensities(1, point, work, &distance, z);
+
+    return logSumExp(k, z);
+}
+
+template<typename T>
+double log_pdf_mix_rows(const BasicMatrixView<T> &X, int k, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+        gaussmix::CovarianceType covariance)
+{
+    check_mixture_size(k, sigma_matrix, mu_matrix, Pks);
+
+    int n = X.rowCount();
+    int m = X.colCount();
+    log_likelihoods.assign(n, 0.0);
+
+    // factor all the covariances (or invert the variances) up front
+    gaussmix::MixtureScorer scorer(covariance, sigma_matrix, mu_matrix, Pks);
+
+    // score a block of points at a time
+    int num_blocks = (n + ESTEP_BLOCK_SIZE - 1)/ESTEP_BLOCK_SIZE;
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif /* _OPENMP */
     {
-        std::vector<double> mean_vec;
-        mu_matrix.getCopyOfRow(i,mean_vec);
-        sum_probs += Pks[i]* \
-                exp(gaussmix::gaussmix_pdf(m,X,*(sigma_matrix[i]),mean_vec));
+        std::vector<double> points((std::size_t)ESTEP_BLOCK_SIZE*m);
+        std::vector<double> work((std::size_t)ESTEP_BLOCK_SIZE*m);
+        std::vector<double> distances(ESTEP_BLOCK_SIZE);
+        std::vector<double> z((std::size_t)ESTEP_BLOCK_SIZE*k);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int first = block*ESTEP_BLOCK_SIZE;
+            int count = std::min(ESTEP_BLOCK_SIZE, n - first);
+            X.copyRowBlock(first, count, &points[0], count);
+
+            scorer.logWeightedDensities(count, &points[0], &work[0], &distances[0], &z[0]);
+            for (int p = 0; p < count; p++)
+                log_likelihoods[first + p] = logSumExp(k, &z[(std::size_t)p*k]);
+        }
     }
 
-    return log(sum_probs);
+    double total = 0.0;
+    for (int p = 0; p < n; p++)
+        total += log_likelihoods[p];
+    return total;
+}
+
+int gaussmix::gaussmix_train(int n, \
+                 int m, \
+                 int k, \
+                 int max_iters, \
+                 const MatrixView & X, \
+                 vector<Matrix*> &sigma_matrix,\
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
+                 double * op_likelihood, \
+                 CovarianceType covariance)
+{
+    return train(n, m, k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood, covariance);
 }
 
 int gaussmix::gaussmix_train(int n, \
                  int m, \
                  int k, \
                  int max_iters, \
-                 Matrix & Y, \
+                 const FloatMatrixView & X, \
                  vector<Matrix*> &sigma_matrix,\
                  Matrix &mu_matrix, \
                  std::vector<double> &Pks, \
+                 double * op_likelihood, \
+                 CovarianceType covariance)
+{
+    return train(n, m, k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood, covariance);
+}
+
+int gaussmix::gaussmix_train_streaming(int n, \
+                 int m, \
+                 int k, \
+                 int max_iters, \
+                 const MatrixView & X, \
+                 vector<Matrix*> &sigma_matrix, \
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
                  double * op_likelihood)
 {
-    clock_t start = clock();
-    double * X = gaussmix::gaussmix_matrixToRaw(Y);
+    if (n != X.rowCount() || m != X.colCount())
+        return GAUSSMIX_GENERAL_ERROR;
 
-    //epsilon is the convergence criteria - the smaller epsilon, the narrower the convergence
-    double epsilon = 0.001;
+    return gaussmix::train_streaming(k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood);
+}
 
-    //initialize iteration counter
-    int counter = 0;
+int gaussmix::gaussmix_train_streaming(int n, \
+                 int m, \
+                 int k, \
+                 int max_iters, \
+                 const FloatMatrixView & X, \
+                 vector<Matrix*> &sigma_matrix, \
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
+                 double * op_likelihood)
+{
+    if (n != X.rowCount() || m != X.colCount())
+        return GAUSSMIX_GENERAL_ERROR;
 
-    // for return code
-    int condition = GAUSSMIX_SUCCESS;
+    return gaussmix::train_streaming(k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood);
+}
+
+int gaussmix::gaussmix_train_sparse(int n, \
+                 int m, \
+                 int k, \
+                 int max_iters, \
+                 const SparseMatrix & X, \
+                 Matrix &variance_matrix, \
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
+                 double * op_likelihood)
+{
+    if (n != X.rowCount() || m != X.colCount())
+        return GAUSSMIX_GENERAL_ERROR;
+
+    return gaussmix::train_sparse_diagonal(k, max_iters, X, variance_matrix, mu_matrix, Pks, op_likelihood);
+}
+
+int gaussmix::gaussmix_train_factor(int n, \
+                 int m, \
+                 int k, \
+                 int rank, \
+                 int max_iters, \
+                 const MatrixView & X, \
+                 vector<Matrix*> &loading_matrix, \
+                 Matrix &variance_matrix, \
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
+                 double * op_likelihood)
+{
+    if (n != X.rowCount() || m != X.colCount())
+        return GAUSSMIX_GENERAL_ERROR;
+
+    return gaussmix::train_factor_analyzers(k, rank, max_iters, X, loading_matrix, variance_matrix, mu_matrix, Pks,
+            op_likelihood);
+}
+
+int gaussmix::gaussmix_train_factor(int n, \
+                 int m, \
+                 int k, \
+                 int rank, \
+                 int max_iters, \
+                 const FloatMatrixView & X, \
+                 vector<Matrix*> &loading_matrix, \
+                 Matrix &variance_matrix, \
+                 Matrix &mu_matrix, \
+                 std::vector<double> &Pks, \
+                 double * op_likelihood)
+{
+    if (n != X.rowCount() || m != X.colCount())
+        return GAUSSMIX_GENERAL_ERROR;
+
+    return gaussmix::train_factor_analyzers(k, rank, max_iters, X, loading_matrix, variance_matrix, mu_matrix, Pks,
+            op_likelihood);
+}
+
+/*! \brief the E and M steps runEM drives for train: estep/mstep, or their structured versions */
+template<typename T>
+struct MixtureSteps
+{
+    MixtureSteps(int n, int m, int k, const BasicMatrixView<T> &X, Matrix &p_nk_matrix, vector<Matrix*> &sigma_matrix,
+                 Matrix &mu_matrix, std::vector<double> &Pks, gaussmix::CovarianceType covariance)
+        : n(n), m(m), k(k), X(X), p_nk_matrix(p_nk_matrix), sigma_matrix(sigma_matrix), mu_matrix(mu_matrix), Pks(Pks),
+          covariance(covariance) {}
+
+    double estep()
+    {
+        if (covariance == gaussmix::COVARIANCE_FULL)
+            return ::estep(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks);
+        return estep_structured(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks, covariance);
+    }
+
+    bool mstep()
+    {
+        if (covariance == gaussmix::COVARIANCE_FULL)
+            return ::mstep(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks);
+        return mstep_structured(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks, covariance);
+    }
+
+    int n, m, k;
+    const BasicMatrixView<T> &X;
+    Matrix &p_nk_matrix;
+    vector<Matrix*> &sigma_matrix;
+    Matrix &mu_matrix;
+    std::vector<double> &Pks;
+    gaussmix::CovarianceType covariance;
+};
+
+template<typename T>
+int train(int n, int m, int k, int max_iters, const BasicMatrixView<T> &X, vector<Matrix*> &sigma_matrix,
+                 Matrix &mu_matrix, std::vector<double> &Pks, double *op_likelihood, gaussmix::CovarianceType covariance)
+{
+    clock_t start = clock();
 
     //initialize the p_nk matrix
     Matrix p_nk_matrix(n,k);
 
-    //initialize likelihoods to zero
-    double new_likelihood = 0.;    
-    double old_likelihood = 0.;
-    
     //take the cluster centroids from kmeans as initial mus 
-    double *kmeans_mu = gaussmix::kmeans(m, X, n, k);
+    double *kmeans_mu = gaussmix::kmeans(X, k);
     
     //if you don't have anything in kmeans_mu, the rest of this will be really hard
     if ( 0 == kmeans_mu )
     {
-        delete[] X;
         if (DEBUG)
             std::cout << "Error: kmeans_mu is empty"<<std::endl;
 
@@ -1319,6 +2160,7 @@ std::cout<< "initial sigma matrix is Identity matrix of size " << m << std::endl
     for (int i = 0; i < k; i++)
         for (int j = 0; j < m; j++)
             mu_matrix.update( kmeans_mu[i*m + j], i, j );
+    delete[] kmeans_mu;
 
 std::cout << "initial mu matrix";
 mu_matrix.print();
@@ -1333,114 +2175,13 @@ std::cout << "data matrix" << std::endl;
     for(int i=0; i<n; ++i)
     {
         for(int j=0; j<m; ++j)
-            std::cout << " " << X[i*m+j];
+            std::cout << " " << X.getValue(i,j);
         std::cout << std::endl;
     }
 
-    //get a new likelihood from estep to have something to start with
-    try
-    {
-        //printf("test pnk value: %f\n", p_nk_matrix.getValue(0,0));
-        //TODO: Need have the ability enforce diagonal sigma ... sum(all elements) > sum(diag())
-        new_likelihood = estep(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks);
-        //printf("new likelihood: %f\n", new_likelihood);
-    }
-    catch (std::exception e)
-    {
-        if (DEBUG)
-            std::cout << "encountered error " << e.what() << std::endl;
-
-        delete[] X;
-        delete[] kmeans_mu;
-
-        // if we can't do first e-step, all bets are off
-        return GAUSSMIX_GENERAL_ERROR;
-    }
-    catch ( ... )
-    {
-        // if we can't do first e-step, all bets are off
-        delete[] X;
-        delete[] kmeans_mu;
-
-        return GAUSSMIX_GENERAL_ERROR;
-    }
-
-    if (DEBUG)
-        std::cout << "new likelihood is " << new_likelihood << std::endl;
-
-    //main loop of EM - this is where the magic happens!
-    while ( (fabs(new_likelihood - old_likelihood) > epsilon) && (counter < max_iters))
-    {
-        if (DEBUG)
-        {
-            std::cout << "new likelihood is " << new_likelihood << std::endl;
-            std::cout << "old likelihood is " << old_likelihood << std::endl;
-        }
-
-        //store new_likelihood as old_likelihood
-        old_likelihood = new_likelihood;
-
-        //here's the mstep exception - if you have a singular matrix, you can't do anything else
-        try
-        {
-            if ( mstep(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks) == false)
-            {
-                if (DEBUG)
-                    std::cout << "Found singular matrix - terminated." << std::endl;
-                condition = GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
-                break;
-            }
-        }
-        catch (LapackError e)
-        {
-            if (DEBUG)
-                std::cout << "Found lapacke error: " << e.what() << std::endl;
-
-            if (counter >= 1)
-            {
-                // able to do at least 1 EM cycle
-                condition = GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED;
-                break;
-            }
-            else
-            {
-                delete[] X;
-                delete[] kmeans_mu;
-                return GAUSSMIX_GENERAL_ERROR;
-            }
-        }
-        catch (...)
-        {
-            delete[] X;
-            delete[] kmeans_mu;
-            return GAUSSMIX_GENERAL_ERROR;
-        }
-        
-        //run estep again to get a new likelihood
-        new_likelihood = estep(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks);
-        
-        //increment the counter
-        counter++;
-    }    // EM algo's while-loop
-
-    delete[] X;
-    delete[] kmeans_mu;
-
-    if (DEBUG)
-    {
-        std::cout << "last new likelihood is " << new_likelihood << std::endl;
-        std::cout << "last old likelihood is " << old_likelihood << std::endl;
-
-        //tell the user how many times EM ran
-        std::cout << "Total number of iterations completed by the EM Algorithm is: " << counter << std::endl;
-    }
-    
-    *op_likelihood =  new_likelihood;
-
-    if (condition >= 0)
-    { // no convergence or convergence?
-        condition = (counter == max_iters ? GAUSSMIX_MAX_ITERS_REACHED : GAUSSMIX_SUCCESS);
-    }
+    //EM proper - this is where the magic happens!
+    MixtureSteps<T> steps(n, m, k, X, p_nk_matrix, sigma_matrix, mu_matrix, Pks, covariance);
+    int condition = runEM(steps, max_iters, op_likelihood);
 
     clock_t end = clock();
     std::cout << "Elapsed time: " << (double)(end-start)/CLOCKS_PER_SEC << " seconds" << std::endl;
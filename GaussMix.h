@@ -40,6 +40,9 @@
 #include <cstring>
 
 #include "Matrix.h"
+#include "MatrixView.h"
+#include "SparseMatrix.h"
+#include "CovarianceModel.h"
 
 using namespace std;
 
@@ -59,6 +62,17 @@ const int GAUSSMIX_MAX_ITERS_REACHED = 1;
 // non-invertible matrix (or other lapacke error) reached after 1 or more EM iterations (non-fatal error)
 const int GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED = 2;
 
+// How the training functions (gaussmix_train, gaussmix_train_sparse, ...) report how EM ended:
+// - GAUSSMIX_SUCCESS: the log likelihood changed by no more than 0.001 between two iterations.
+// - GAUSSMIX_MAX_ITERS_REACHED: max_iters M-steps ran without that happening.
+// - GAUSSMIX_NONINVERTIBLE_MATRIX_REACHED: an M-step left a model that cannot be evaluated (a
+//   singular covariance, an empty cluster, or a log likelihood that is not finite). EM stops there,
+//   and the returned model and likelihood are those of that last step.
+// - GAUSSMIX_GENERAL_ERROR: the first E-step failed or gave a log likelihood that is not finite, or
+//   a lapacke error occurred before one full EM iteration completed.
+// Earlier versions reported a non-invertible stop as SUCCESS or MAX_ITERS_REACHED, and a NaN
+// likelihood as convergence.
+
 // data file not found (fatal error)
 const int GAUSSMIX_FILE_NOT_FOUND = -1;
 
@@ -76,7 +90,7 @@ const int GAUSSMIX_GENERAL_ERROR = -2;
 /*! \brief gaussmix_adapt: adapt a Gaussian Mixture model to a given sub-population.
 *
 *
-@param[in] X subpopulation data (dimensionality = sigma_matrix.num_cols)
+@param[in] X view of subpopulation data (dimensionality = sigma_matrix.num_cols); a Matrix converts implicitly
 @param[in] n number of data points in sub-pop
 @param[in] sigma_matrix vector of covariance matrices from EM call
 @param [in] mu_matrix cluster means returned from EM call
@@ -84,11 +98,21 @@ const int GAUSSMIX_GENERAL_ERROR = -2;
 @param[out] adapted_sigma_matrix vector of covariance matrices (caller allocates)
 @param [out] adapted_mu_matrix cluster means (caller allocates)
 @param [out] adapted_Pks cluster weights (caller allocates)
+@param [in] covariance structure of the model's covariances; the adapted ones are given the same structure
 @returns a GAUSSMIX_ condition code (see above)
 */
-int gaussmix_adapt(Matrix & X, int n, vector<Matrix*> &sigma_matrix,
-        Matrix &mu_matrix, std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
-        Matrix &adapted_mu_matrix, std::vector<double>& adapted_Pks);
+int gaussmix_adapt(const MatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
+        Matrix &adapted_mu_matrix, std::vector<double>& adapted_Pks, CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_adapt: adapt a Gaussian Mixture model to a sub-population held as float32 data.
+*
+* Same as above; the data are read as floats and widened as they are used, while all the statistics
+* (posteriors, means, covariances) are accumulated in double.
+*/
+int gaussmix_adapt(const FloatMatrixView & X, int n, const vector<Matrix*> &sigma_matrix,
+        const Matrix &mu_matrix, const std::vector<double> &Pks, vector<Matrix*> &adapted_sigma_matrix,
+        Matrix &adapted_mu_matrix, std::vector<double>& adapted_Pks, CovarianceType covariance = COVARIANCE_FULL);
 
 /*! \brief convert the matrix representation of the data to a flat array (caller must delete[]).
  * @param M the matrix (m rows X n cols)
@@ -109,6 +133,21 @@ double * gaussmix_matrixToRaw(const Matrix & X);
 */
 int gaussmix_parse(char *file_name,  int n, int m, Matrix & data, int & localSamples, std::vector<int> & labels);
 
+/*! \brief gaussmix_parse_sparse: reads csv or svm-format data into a sparse matrix.
+*
+* svm-format lines may list any subset of the indices 1..m, in any order; absent indices are 0.
+* Lines may be of any length. Under MPI each node reads its own block of lines.
+*
+@param[in] file_name ptr to full file path
+@param[in] n the number of data points
+@param[in] m dimensionality of the data
+@param[out] data sparse matrix of the (local) data points
+@param[out] localSamples number of data points read by this MPI job
+@param[out] labels labels for svm format, 0s for csv format
+@returns  a GASSMIX_ condition code (see above).
+*/
+int gaussmix_parse_sparse(char *file_name, int n, int m, SparseMatrix & data, int & localSamples, std::vector<int> & labels);
+
 
 /*! \brief gaussmix_pdf: compute the log of the  probability of the given data point
 *
@@ -119,7 +158,22 @@ int gaussmix_parse(char *file_name,  int n, int m, Matrix & data, int & localSam
 @param [in] mu_vector  mean for cluster
 @return log likelihood
 */
-double gaussmix_pdf(int m, std::vector<double> X,Matrix &sigma_matrix,std::vector<double> &mu_vector);
+double gaussmix_pdf(int m, const std::vector<double> &X, const Matrix &sigma_matrix, const std::vector<double> &mu_vector);
+
+/*! \brief gaussmix_pdf: compute the log of the  probability of a data point held in a matrix view
+*
+*
+@param[in] X view of data (dimensionality = X.colCount()); not copied
+@param[in] row 0-rel row of X holding the data point
+@param[in] sigma_matrix covariance matrix for cluster
+@param [in] mu_vector  mean for cluster
+@return log likelihood
+*/
+double gaussmix_pdf(const MatrixView &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector);
+
+/*! \brief gaussmix_pdf: as above, for a data point held as float32 data
+*/
+double gaussmix_pdf(const FloatMatrixView &X, int row, const Matrix &sigma_matrix, const std::vector<double> &mu_vector);
 
 
 /*! \brief gaussmix_pdf_mix: compute the log of the mixture probability of the given data point
@@ -131,10 +185,119 @@ double gaussmix_pdf(int m, std::vector<double> X,Matrix &sigma_matrix,std::vecto
 @param[in] sigma_matrix vector of covariance matrices from EM or adpated call
 @param [in] mu_matrix cluster means returned from EM or adapted call
 @param [in] Pks cluster weights returned by EM or adapted call
+@param [in] covariance structure of the covariances (see CovarianceType)
+@return log likelihood
+@throw SizeError if sigma_matrix, Pks or the rows of mu_matrix do not number k
+*/
+double gaussmix_pdf_mix(int m, int k, const std::vector<double> &X, const vector<Matrix*> &sigma_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks,
+                        CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_pdf_mix: compute the log of the mixture probability of a data point held in a matrix view
+*
+*
+@param[in] X view of data (dimensionality = X.colCount()); not copied
+@param[in] row 0-rel row of X holding the data point
+@param[in] k number of clusters
+@param[in] sigma_matrix vector of covariance matrices from EM or adpated call
+@param [in] mu_matrix cluster means returned from EM or adapted call
+@param [in] Pks cluster weights returned by EM or adapted call
+@param [in] covariance structure of the covariances (see CovarianceType)
+@return log likelihood
+@throw SizeError if sigma_matrix, Pks or the rows of mu_matrix do not number k
+*/
+double gaussmix_pdf_mix(const MatrixView &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks,
+                        CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_pdf_mix: as above, for a data point held as float32 data
+*/
+double gaussmix_pdf_mix(const FloatMatrixView &X, int row, int k, const vector<Matrix*> &sigma_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks,
+                        CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_pdf_mix: score every row of a matrix view at once: the log of the mixture probability
+*   of each data point. Points are scored in blocks, so this is much faster than a call per row.
+*
+*
+@param[in] X view of data, one point per row (dimensionality = X.colCount()); not copied
+@param[in] k number of clusters
+@param[in] sigma_matrix vector of covariance matrices from EM or adpated call
+@param [in] mu_matrix cluster means returned from EM or adapted call
+@param [in] Pks cluster weights returned by EM or adapted call
+@param [out] log_likelihoods log likelihood of each row (resized to X.rowCount())
+@param [in] covariance structure of the covariances (see CovarianceType)
+@return log likelihood of all the rows (the sum of log_likelihoods)
+@throw SizeError if sigma_matrix, Pks or the rows of mu_matrix do not number k
+*/
+double gaussmix_pdf_mix(const MatrixView &X, int k, const vector<Matrix*> &sigma_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+                        CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_pdf_mix: as above, for data held as float32
+*/
+double gaussmix_pdf_mix(const FloatMatrixView &X, int k, const vector<Matrix*> &sigma_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks, std::vector<double> &log_likelihoods,
+                        CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_pdf_mix_sparse: compute the log of the mixture probability of a sparse data point
+*   under a diagonal-covariance model (see gaussmix_train_sparse), in O(k * non-zeros)
+*
+*
+@param[in] X sparse data
+@param[in] row 0-rel row of X holding the data point
+@param[in] k number of clusters
+@param[in] variance_matrix k x m matrix of the diagonals of the covariances
+@param [in] mu_matrix k x m matrix of cluster means
+@param [in] Pks cluster weights
+@return log likelihood
+@throw SizeError if Pks or the rows of variance_matrix or mu_matrix do not number k
+*/
+double gaussmix_pdf_mix_sparse(const SparseMatrix &X, int row, int k, const Matrix &variance_matrix,
+                        const Matrix &mu_matrix, const std::vector<double> &Pks);
+
+/*! \brief gaussmix_pdf_mix_factor: compute the log of the mixture probability of a data point under a
+*   mixture of factor analyzers (see gaussmix_train_factor), in O(k*m*r)
+*
+*
+@param[in] X view of data
+@param[in] row 0-rel row of X holding the data point
+@param[in] k number of clusters
+@param[in] loading_matrix k m x r loading matrices W (each covariance is W*W' + D)
+@param[in] variance_matrix k x m matrix of the diagonals D
+@param [in] mu_matrix k x m matrix of cluster means
+@param [in] Pks cluster weights
 @return log likelihood
 */
-double gaussmix_pdf_mix(int m, int k, std::vector<double> X, vector<Matrix*> &sigma_matrix,
-                        Matrix &mu_matrix, std::vector<double> &Pks);
+double gaussmix_pdf_mix_factor(const MatrixView &X, int row, int k, const vector<Matrix*> &loading_matrix,
+                        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks);
+
+/*! \brief gaussmix_pdf_mix_factor: as above, for a data point held as float32 data
+*/
+double gaussmix_pdf_mix_factor(const FloatMatrixView &X, int row, int k, const vector<Matrix*> &loading_matrix,
+                        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks);
+
+/*! \brief gaussmix_pdf_mix_factor: score every row of a matrix view at once under a mixture of factor analyzers
+*
+*
+@param[in] X view of data, one point per row; not copied
+@param[in] k number of clusters
+@param[in] loading_matrix k m x r loading matrices W (each covariance is W*W' + D)
+@param[in] variance_matrix k x m matrix of the diagonals D
+@param [in] mu_matrix k x m matrix of cluster means
+@param [in] Pks cluster weights
+@param [out] log_likelihoods log likelihood of each row (resized to X.rowCount())
+@return log likelihood of all the rows (the sum of log_likelihoods)
+*/
+double gaussmix_pdf_mix_factor(const MatrixView &X, int k, const vector<Matrix*> &loading_matrix,
+                        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks,
+                        std::vector<double> &log_likelihoods);
+
+/*! \brief gaussmix_pdf_mix_factor: as above, for data held as float32
+*/
+double gaussmix_pdf_mix_factor(const FloatMatrixView &X, int k, const vector<Matrix*> &loading_matrix,
+                        const Matrix &variance_matrix, const Matrix &mu_matrix, const std::vector<double> &Pks,
+                        std::vector<double> &log_likelihoods);
 
 
 
@@ -146,21 +309,158 @@ double gaussmix_pdf_mix(int m, int k, std::vector<double> X, vector<Matrix*> &si
 @param[in] m dimensionality of data
 @param[in] k number of clusters
 @param[in] max number of EM iterations
-@param[in] X data points
+@param[in] X view of the n x m data points, used in place (a Matrix converts implicitly; row-major
+           views of caller-owned or mmapped memory are read without any copy)
 @param[out] sigma_matrix vector of matrix pointers generated by the caller of EM that holds the sigmas calculated
 @param[out] mu_matrix matrix that holds the mu approximations
 @param[out] Pks local copy of the cluster weights generated by the caller of EM that holds the Pk's calculated
 @param[out] likelihood the log likelihood (density) of the data (or std::numeric_limits::infinity() on fatal error)
+@param[in] covariance structure to fit the covariances with (see CovarianceType). Diagonal and spherical
+           iterations are O(n*k*m) and make no LAPACK calls; tied factors one covariance per iteration.
+           Whatever the structure, sigma_matrix holds k m x m matrices.
 @return one of the GAUSSMIX_ condition codes (see above)
 */
 int gaussmix_train(int n, 
            int m, 
            int k, 
            int max_iters, 
-           Matrix & X, 
+           const MatrixView & X, 
            vector<Matrix*> &sigma_matrix,
            Matrix &mu_matrix, 
            std::vector<double>& Pks, 
+           double * likelihood,
+           CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_train: train a Gaussian Mixture model on float32 data.
+*
+* Same as above, but the n x m data points are single precision - half the memory and bandwidth of
+* the double version. Points are widened to double as they are read; responsibilities, sums, means,
+* covariances and their factorizations are all kept in double, so precision is only lost in the inputs.
+*/
+int gaussmix_train(int n,
+           int m,
+           int k,
+           int max_iters,
+           const FloatMatrixView & X,
+           vector<Matrix*> &sigma_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
+           double * likelihood,
+           CovarianceType covariance = COVARIANCE_FULL);
+
+/*! \brief gaussmix_train_streaming: train a Gaussian Mixture model without storing the n x k responsibilities.
+*
+* Same model, starting point and updates as gaussmix_train, but each EM iteration is a single pass over
+* the data that scores a block of points and immediately folds its responsibilities into per-component
+* sufficient statistics (sum of r, r*x and r*x*x'). Memory is O(k*m*m) per thread instead of O(n*k),
+* so the number of points per node is limited only by the data itself.
+*
+@param[in] n number of data points
+@param[in] m dimensionality of data
+@param[in] k number of clusters
+@param[in] max number of EM iterations
+@param[in] X view of the n x m data points; not copied
+@param[out] sigma_matrix vector of k m x m covariance matrices (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes (see above)
+*/
+int gaussmix_train_streaming(int n,
+           int m,
+           int k,
+           int max_iters,
+           const MatrixView & X,
+           vector<Matrix*> &sigma_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
+           double * likelihood);
+
+/*! \brief gaussmix_train_streaming: as above, for float32 data
+*/
+int gaussmix_train_streaming(int n,
+           int m,
+           int k,
+           int max_iters,
+           const FloatMatrixView & X,
+           vector<Matrix*> &sigma_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
+           double * likelihood);
+
+/*! \brief gaussmix_train_sparse: train a diagonal-covariance Gaussian Mixture model on sparse data.
+*
+* Every pass over the data costs O(k * non-zeros): a point's zero dimensions are never touched.
+* Only the variances are estimated (the covariances are diagonal), so they are returned as a
+* k x m matrix rather than k m x m matrices. Variances are floored at a small positive value,
+* since sparse data often has dimensions that are constant within a cluster.
+*
+@param[in] n number of data points
+@param[in] m dimensionality of data
+@param[in] k number of clusters
+@param[in] max number of EM iterations
+@param[in] X n x m sparse data points
+@param[out] variance_matrix k x m matrix of the diagonals of the covariances (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes (see above)
+*/
+int gaussmix_train_sparse(int n,
+           int m,
+           int k,
+           int max_iters,
+           const SparseMatrix & X,
+           Matrix &variance_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
+           double * likelihood);
+
+/*! \brief gaussmix_train_factor: train a mixture of factor analyzers, a Gaussian Mixture model whose
+*   covariances are low rank plus diagonal, W*W' + D.
+*
+* For high-dimensional data, where k full m x m covariances are too big to store, too slow to factor
+* or too poorly determined by the data. The model is O(k*m*r); densities use the Woodbury identity, so
+* only r x r matrices are factored and a point costs O(m*r) per cluster. Like gaussmix_train_streaming,
+* each iteration is a single pass over the data that keeps no n x k responsibilities.
+*
+@param[in] n number of data points
+@param[in] m dimensionality of data
+@param[in] k number of clusters
+@param[in] rank number of factors r per cluster (1 <= r < m)
+@param[in] max number of EM iterations
+@param[in] X view of the n x m data points; not copied
+@param[out] loading_matrix k m x r loading matrices W (caller allocates)
+@param[out] variance_matrix k x m matrix of the diagonals D (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes (see above)
+*/
+int gaussmix_train_factor(int n,
+           int m,
+           int k,
+           int rank,
+           int max_iters,
+           const MatrixView & X,
+           vector<Matrix*> &loading_matrix,
+           Matrix &variance_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
+           double * likelihood);
+
+/*! \brief gaussmix_train_factor: as above, for float32 data
+*/
+int gaussmix_train_factor(int n,
+           int m,
+           int k,
+           int rank,
+           int max_iters,
+           const FloatMatrixView & X,
+           vector<Matrix*> &loading_matrix,
+           Matrix &variance_matrix,
+           Matrix &mu_matrix,
+           std::vector<double>& Pks,
            double * likelihood);
 
  void init(int *argc, char ***argv);
@@ -170,6 +470,6 @@ int gaussmix_train(int n,
 
  int parse_line(char * buffer, Matrix & X, std::vector<int> & labels, int row, int m);
 
-#endif //EM_ALGORITHM_HEADER
-
 };
+
+#endif //EM_ALGORITHM_HEADER
@@ -39,6 +39,8 @@
 #include <stdio.h>
 
 #include "KMeans.h"
+#include "AlignedAllocator.h"
+#include "Kernels.h"
 
 /*! \file KMeans.cpp
 *   \brief implementations for kmeans clustering algorithm
@@ -62,15 +64,22 @@ using namespace std;
  *                         INTERNAL FUNCTION PROTOTYPES
  ********************************************************************************************************/
 
-void all_distances(int m, int n, int k, double *X, double *centroid, double *distance_out);
+template<typename T>
+void all_distances(int m, int n, int k, const BasicMatrixView<T> &X, const double *centroid, int ld, double *distance_out);
 int assignment_change_count (int n, int a[], int b[]);
-void calc_cluster_centroids(int m, int n, int k, double *X, int *cluster_assignment_index, double *new_cluster_centroid);
-double calc_total_distance(int m, int n, int k, double *X, double *centroids, int *cluster_assignment_index);
-void choose_all_clusters_from_distances(int m, int n, int k, double *X, double *distance_array, int *cluster_assignment_index);
-void cluster_diag(int m, int n, int k, double *X, int *cluster_assignment_index, double *cluster_centroid);
+template<typename T>
+void calc_cluster_centroids(int m, int n, int k, const BasicMatrixView<T> &X, int *cluster_assignment_index, double *new_cluster_centroid, int ld);
+template<typename T>
+double calc_total_distance(int m, int n, int k, const BasicMatrixView<T> &X, const double *centroids, int ld, int *cluster_assignment_index);
+template<typename T>
+void choose_all_clusters_from_distances(int m, int n, int k, const BasicMatrixView<T> &X, double *distance_array, int *cluster_assignment_index);
+template<typename T>
+void cluster_diag(int m, int n, int k, const BasicMatrixView<T> &X, int *cluster_assignment_index, const double *cluster_centroid, int ld);
 void copy_assignment_array(int n, int *src, int *tgt);
-double euclid_distance(int m, double *p1, double *p2);
+double euclid_distance(int m, const double *p1, const double *p2);
 void get_cluster_member_count(int n, int k, int *cluster_assignment_index, int *cluster_member_count);
+template<typename T>
+double * cluster(const BasicMatrixView<T> &X, int k);
 
 /*************************************************************************************************************
  *                                   SUPPORT FUNCTIONS
@@ -85,23 +94,29 @@ void get_cluster_member_count(int n, int k, int *cluster_assignment_index, int *
 *    @param m dimensionality of data
 *    @param n number of data points
 *    @param k number of clusters
-*    @param X ptr to data
-*    @param centroid ptr to centroids
+*    @param X view of data
+*    @param centroid ptr to centroids (one row per cluster)
+*    @param ld distance between consecutive centroids
 *
 *    output -
 *    @param distance_out array of distances (first cluster followed by second cluster etc)
 *
 */
 
-void all_distances(int m, int n, int k, double *X, double *centroid, double *distance_out)
+template<typename T>
+void all_distances(int m, int n, int k, const BasicMatrixView<T> &X, const double *centroid, int ld, double *distance_out)
 {
+    double scratch[m];
+
     //for each data point
     for (int ii = 0; ii < n; ii++)
     {
+        const double *x = X.row(ii, scratch);
+
         //for each cluster
         for (int jj = 0; jj < k; jj++)
         {
-            distance_out[ii*k + jj] = euclid_distance(m, &X[ii*m], &centroid[jj*m]);
+            distance_out[ii*k + jj] = euclid_distance(m, x, &centroid[jj*ld]);
         }
     }
 }
@@ -137,28 +152,31 @@ int assignment_change_count (int n, int a[], int b[])
 *    @param m data dimensions
 *    @param n number of data points
 *    @param k number of clusters
-*    @param X ptr to data
+*    @param X view of data
 *    @param cluster_assignment_index old cluster assignments
 *
 *    output - void
-*    @param new_cluster_centroid the new centroids
+*    @param new_cluster_centroid the new centroids (one row per cluster)
+*    @param ld distance between consecutive centroids
 *
 */
 
-void calc_cluster_centroids(int m, int n, int k, double *X, int *cluster_assignment_index, double *new_cluster_centroid)
+template<typename T>
+void calc_cluster_centroids(int m, int n, int k, const BasicMatrixView<T> &X, int *cluster_assignment_index, double *new_cluster_centroid, int ld)
 {
     //for each cluster
     for (int b = 0; b < k; b++)
         if (DEBUG) printf("\n%f\n", new_cluster_centroid[b]);
 
     int cluster_member_count[k];
+    double scratch[m];
 
     // initialize cluster centroid coordinate sums to zero
     for (int ii = 0; ii < k; ii++)
     {
         for (int jj = 0; jj < m; jj++)
         {
-            new_cluster_centroid[ii*m + jj] = 0;
+            new_cluster_centroid[ii*ld + jj] = 0;
         }
     }
     //for each data point
@@ -166,16 +184,17 @@ void calc_cluster_centroids(int m, int n, int k, double *X, int *cluster_assignm
     {
         // which cluster it's in
         int active_cluster = cluster_assignment_index[ii];
+        const double *x = X.row(ii, scratch);
 
         // sum point coordinates for finding centroid
         for (int jj = 0; jj < m; jj++)
-            new_cluster_centroid[active_cluster*m + jj] += X[ii*m + jj];
+            new_cluster_centroid[active_cluster*ld + jj] += x[jj];
     }
 #ifdef UseMPI
     {
-      double global_cluster_centroid[k*m];
-      MPI_Allreduce(new_cluster_centroid, global_cluster_centroid, k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      memcpy(new_cluster_centroid,global_cluster_centroid,k*m*sizeof(double));
+      double global_cluster_centroid[k*ld];
+      MPI_Allreduce(new_cluster_centroid, global_cluster_centroid, k*ld, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      memcpy(new_cluster_centroid,global_cluster_centroid,k*ld*sizeof(double));
     }
 #endif /* UseMPI */
     // divide each coordinate sum by number of members to find mean(centroid) for each cluster
@@ -187,7 +206,7 @@ void calc_cluster_centroids(int m, int n, int k, double *X, int *cluster_assignm
 
         // for each dimension
         for (int jj = 0; jj < m; jj++)
-            new_cluster_centroid[ii*m + jj] /= cluster_member_count[ii];
+            new_cluster_centroid[ii*ld + jj] /= cluster_member_count[ii];
             // warning!! will divide by zero here for any empty clusters
     }
 }
@@ -200,16 +219,19 @@ void calc_cluster_centroids(int m, int n, int k, double *X, int *cluster_assignm
 *    @param m dimensionality of data
 *    @param n number of data points
 *    @param k number of clusters
-*    @param X ptr to data
-*    @param centroids ptr to centroids
+*    @param X view of data
+*    @param centroids ptr to centroids (one row per cluster)
+*    @param ld distance between consecutive centroids
 *    @param cluster_assignment_index ptr to array of cluster assignments
 *    @return the total distance
 * note: a point with a cluster assignment of -1 is ignored.
 */
 
-double calc_total_distance(int m, int n, int k, double *X, double *centroids, int *cluster_assignment_index)
+template<typename T>
+double calc_total_distance(int m, int n, int k, const BasicMatrixView<T> &X, const double *centroids, int ld, int *cluster_assignment_index)
 {
     double tot_D = 0;
+    double scratch[m];
     //for each data point
     for (int ii = 0; ii < n; ii++)
     {
@@ -217,7 +239,7 @@ double calc_total_distance(int m, int n, int k, double *X, double *centroids, in
         int active_cluster = cluster_assignment_index[ii];
         //sum distance
         if (active_cluster != -1)
-            tot_D += euclid_distance(m, &X[ii*m], &centroids[active_cluster*m]);
+            tot_D += euclid_distance(m, X.row(ii, scratch), &centroids[active_cluster*ld]);
     }
 #ifdef UseMPI
     // Sum this over all nodes
@@ -238,11 +260,12 @@ double calc_total_distance(int m, int n, int k, double *X, double *centroids, in
 *    @param m dimensionality of data
 *    @param n number of data points
 *    @param k number of clusters
-*    @param X ptr to data
+*    @param X view of data
 *    @param distance_array array of distances to cluster
 *    @param[out] cluster_assignment_index the updated assignments (old assignmemnts passed in)
 */
-void choose_all_clusters_from_distances(int m, int n, int k, double *X, double *distance_array, int *cluster_assignment_index)
+template<typename T>
+void choose_all_clusters_from_distances(int m, int n, int k, const BasicMatrixView<T> &X, double *distance_array, int *cluster_assignment_index)
 {
     //for each data point
     for (int ii = 0; ii < n; ii++)
@@ -271,12 +294,14 @@ void choose_all_clusters_from_distances(int m, int n, int k, double *X, double *
 *    @param m dimensionality of data
 *    @param n number of data points
 *    @param k number of clusters
-*    @param X ptr to data
+*    @param X view of data
 *    @param cluster_assignment_index ptr to cluster assignments
-*    @param cluster_centroid ptr to centroids
+*    @param cluster_centroid ptr to centroids (one row per cluster)
+*    @param ld distance between consecutive centroids
 */
 
-void cluster_diag(int m, int n, int k, double *X, int *cluster_assignment_index, double *cluster_centroid)
+template<typename T>
+void cluster_diag(int m, int n, int k, const BasicMatrixView<T> &X, int *cluster_assignment_index, const double *cluster_centroid, int ld)
 {
   // MPI TODO: Make this work in parallel environment
   // May not be critical - primarily used for DEBUGging.  Maybe that makes it critical!
@@ -299,7 +324,7 @@ void cluster_diag(int m, int n, int k, double *X, int *cluster_assignment_index,
         printf(" ( ");
         for (int jj = 0; jj < m; jj++)
         {
-            printf("%lf ",cluster_centroid[ii*m + jj]);
+            printf("%lf ",cluster_centroid[ii*ld + jj]);
             if (jj != m-1)
                 printf(", ");
         }
@@ -347,13 +372,9 @@ void copy_assignment_array(int n, int *src, int *tgt)
 *    @return the distance
 */
 
-double euclid_distance(int m, double *p1, double *p2)
+double euclid_distance(int m, const double *p1, const double *p2)
 {
-    double distance_sum = 0;
-    for (int ii = 0; ii < m; ii++)
-        distance_sum += std::pow(p1[ii] - p2[ii],2);
-    return std::sqrt(distance_sum);
-    if (DEBUG) std::cout << "this iteration's distance sum is " << distance_sum << std::endl;
+    return std::sqrt(squaredDistance(m, p1, p2));
 }
 
 
@@ -392,6 +413,27 @@ void get_cluster_member_count(int n, int k, int *cluster_assignment_index, int *
 
 double * gaussmix::kmeans(int m, double *X, int n, int k)
 {
+    return gaussmix::kmeans(MatrixView(X, n, m, m, Matrix::ROW_MAJOR), k);
+}
+
+double * gaussmix::kmeans(const MatrixView &X, int k)
+{
+    return cluster(X, k);
+}
+
+double * gaussmix::kmeans(const FloatMatrixView &X, int k)
+{
+    return cluster(X, k);
+}
+
+/*! \brief body of the public kmeans routines, for double or float data (centroids are always double)
+*/
+template<typename T>
+double * cluster(const BasicMatrixView<T> &X, int k)
+{
+    int n = X.rowCount();
+    int m = X.colCount();
+
     // FIXME: use smart pointers here
     if( n<k )
     {
@@ -399,8 +441,10 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
         return 0;
     }
 
-    //holds the computed cluster_centroids to pass to EM later
-        double *cluster_centroid = new double[m*k];
+    //working copy of the cluster centroids: aligned, one padded row per cluster
+    int ld = paddedLeadingDimension(m);
+    AlignedVector<double> centroid_rows(k*ld, 0.0);
+    double *cluster_centroid = &centroid_rows[0];
 
     //for each data point, the distance to each centroid
     double *dist = new double[n*k];
@@ -482,11 +526,13 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
             row = row - scanDataPoints + n;
 #endif /* UseMPI */
             // Copy that row into the centroid
-            memcpy(&(cluster_centroid[i*m]),&(X[row*m]),m*sizeof(double));
+            const double *x = X.row(row, &(cluster_centroid[i*ld]));
+            if (x != &(cluster_centroid[i*ld]))
+                memcpy(&(cluster_centroid[i*ld]),x,m*sizeof(double));
 #ifdef UseMPI
         }
         //Share this centroid across the nodes
-        MPI_Bcast(&(cluster_centroid[i*m]), m, MPI_DOUBLE, globalNodeWithRow, MPI_COMM_WORLD);
+        MPI_Bcast(&(cluster_centroid[i*ld]), m, MPI_DOUBLE, globalNodeWithRow, MPI_COMM_WORLD);
 #endif /* UseMPI */
 
     }
@@ -496,14 +542,15 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
     if (myNode == 0)
       {
         std::cout<<"Centroids in k means:"<<std::endl;
-        for (int i=0; i<k*m; i++)
-          std::cout << cluster_centroid[i]<<", ";
+        for (int i=0; i<k; i++)
+          for (int j=0; j<m; j++)
+            std::cout << cluster_centroid[i*ld + j]<<", ";
         std::cout << std::endl;
       }
       }
 
     //calculate distances
-    all_distances(m, n, k, X, cluster_centroid, dist);
+    all_distances(m, n, k, X, cluster_centroid, ld, dist);
 
     //pick clusters from the previously calculated distances
     choose_all_clusters_from_distances(m, n, k, X, dist, cluster_assignment_cur);
@@ -522,16 +569,16 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
             std::cout << "batch iteration " << batch_iteration << std::endl;
 
         //diagram the current cluster situation
-        cluster_diag(m, n, k, X, cluster_assignment_cur, cluster_centroid);
+        cluster_diag(m, n, k, X, cluster_assignment_cur, cluster_centroid, ld);
 
         //calculate the cluster centroids
-        calc_cluster_centroids(m, n, k, X, cluster_assignment_cur, cluster_centroid);
+        calc_cluster_centroids(m, n, k, X, cluster_assignment_cur, cluster_centroid, ld);
 
         //store the total distance calculated by calc_total_distance in a double for further use
-        double totD = calc_total_distance(m, n, k, X, cluster_centroid, cluster_assignment_cur);
+        double totD = calc_total_distance(m, n, k, X, cluster_centroid, ld, cluster_assignment_cur);
 
         //smoosh points around to nearest cluster by recalculating distances
-        all_distances(m, n, k, X, cluster_centroid, dist);
+        all_distances(m, n, k, X, cluster_centroid, ld, dist);
 
         //pick new clusters based on new distance calculation
         choose_all_clusters_from_distances(m, n, k, X, dist, cluster_assignment_cur);
@@ -558,7 +605,7 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
 
     }
     //sanity check
-    if (DEBUG) cluster_diag(m, n, k, X, cluster_assignment_cur, cluster_centroid);
+    if (DEBUG) cluster_diag(m, n, k, X, cluster_assignment_cur, cluster_centroid, ld);
 
     delete[] dist;
     if (DEBUG) printf("%p \n",cluster_assignment_cur);
@@ -566,7 +613,10 @@ double * gaussmix::kmeans(int m, double *X, int n, int k)
     delete[] cluster_assignment_prev;
     delete[] point_move_score;
 
-    // return the final centroids calculated by Kmeans for use by EM later
-    return cluster_centroid;
+    // return the final centroids calculated by Kmeans for use by EM later, packed k * m
+    double *centroids_out = new double[m*k];
+    for (int i = 0; i < k; i++)
+        memcpy(&centroids_out[i*m], &cluster_centroid[i*ld], m*sizeof(double));
+    return centroids_out;
 
 }
@@ -35,6 +35,8 @@
 #ifndef K_MEANS_H_
 #define K_MEANS_H_
 
+#include "MatrixView.h"
+
 namespace gaussmix
 {
 
@@ -48,5 +50,21 @@ namespace gaussmix
 */
 double * kmeans(int dim, double *X, int n, int k);
 
+/*! \brief kmeans cluster the rows of the given data, in place
+*
+@param[in] X view of the n * dim data to be clustered (not copied)
+@param[in] k desired number of clusters
+@return heap-allocated k * dim array of cluster centroids (call must free) or 0 on error
+*/
+double * kmeans(const MatrixView & X, int k);
+
+/*! \brief kmeans cluster the rows of the given float32 data, in place (centroids are computed in double)
+*
+@param[in] X view of the n * dim data to be clustered (not copied)
+@param[in] k desired number of clusters
+@return heap-allocated k * dim array of cluster centroids (call must free) or 0 on error
+*/
+double * kmeans(const FloatMatrixView & X, int k);
+
 }
 #endif /* K_MEANS_H_ */
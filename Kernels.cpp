@@ -0,0 +1,255 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file Kernels.cpp
+*   \brief kernel implementations
+*
+* On x86 each kernel is built several times - for AVX-512, AVX2 and the baseline (SSE2) - and the
+* loader picks the widest one the CPU supports, so one library binary uses the full vector width
+* on every host without any -march flag. The reductions are marked omp simd, as vectorizing them
+* reorders the sums (which the compiler will not otherwise do without -ffast-math).
+*/
+
+#include <cmath>
+
+#include "Kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define GAUSSMIX_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+
+#ifndef GAUSSMIX_KERNEL
+#define GAUSSMIX_KERNEL
+#endif
+
+
+/**
+\brief squared euclidean distance
+@param m length of the vectors
+@param a vector
+@param b vector
+@return |a-b|^2
+*/
+GAUSSMIX_KERNEL
+double squaredDistance(int m, const double a[], const double b[])
+{
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < m; i++)
+    {
+        double d = a[i] - b[i];
+        sum += d*d;
+    }
+    return sum;
+}
+
+/**
+\brief squared Mahalanobis distance with a whitener: the product W*(x-mu) is formed a column
+at a time, so the inner loop is a contiguous axpy
+@param m dimension
+@param W lower triangular whitener, column-major
+@param ld leading dimension of W
+@param x vector
+@param mu mean vector
+@return |W*(x-mu)|^2
+*/
+GAUSSMIX_KERNEL
+double mahalanobisWhitened(int m, const double W[], int ld, const double x[], const double mu[])
+{
+    double y[m];
+    for (int i = 0; i < m; i++)
+        y[i] = 0.0;
+
+    for (int j = 0; j < m; j++)
+    {
+        double z_j = x[j] - mu[j];
+        const double * column = W + (long)j*ld;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif /* _OPENMP */
+        for (int i = j; i < m; i++)
+            y[i] += column[i] * z_j;
+    }
+
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < m; i++)
+        sum += y[i]*y[i];
+    return sum;
+}
+
+/**
+\brief squared Mahalanobis distance with the cholesky factor: column-oriented forward substitution,
+so again the inner loop is a contiguous axpy
+@param m dimension
+@param L lower triangular cholesky factor, column-major
+@param ld leading dimension of L
+@param x vector
+@param mu mean vector
+@return |inv(L)*(x-mu)|^2
+*/
+GAUSSMIX_KERNEL
+double mahalanobisSolve(int m, const double L[], int ld, const double x[], const double mu[])
+{
+    double z[m];
+    for (int i = 0; i < m; i++)
+        z[i] = x[i] - mu[i];
+
+    for (int j = 0; j < m; j++)
+    {
+        const double * column = L + (long)j*ld;
+        z[j] /= column[j];
+        double z_j = z[j];
+#ifdef _OPENMP
+        #pragma omp simd
+#endif /* _OPENMP */
+        for (int i = j+1; i < m; i++)
+            z[i] -= column[i] * z_j;
+    }
+
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < m; i++)
+        sum += z[i]*z[i];
+    return sum;
+}
+
+/**
+\brief log of a sum of exponentials
+@param k number of terms
+@param z the terms
+@return log(sum(exp(z)))
+*/
+GAUSSMIX_KERNEL
+double logSumExp(int k, const double z[])
+{
+    double z_max = z[0];
+#ifdef _OPENMP
+    #pragma omp simd reduction(max:z_max)
+#endif /* _OPENMP */
+    for (int i = 1; i < k; i++)
+        z_max = z[i] > z_max ? z[i] : z_max;
+
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < k; i++)
+        sum += exp(z[i] - z_max);
+
+    return log(sum) + z_max;
+}
+
+/**
+\brief normalize log weights in place: z -= log(sum(exp(z)))
+@param k number of terms
+@param z the terms; on return, the log of each term's share of the total
+@return log(sum(exp(z))) of the terms as given
+*/
+GAUSSMIX_KERNEL
+double logNormalize(int k, double z[])
+{
+    double z_max = z[0];
+#ifdef _OPENMP
+    #pragma omp simd reduction(max:z_max)
+#endif /* _OPENMP */
+    for (int i = 1; i < k; i++)
+        z_max = z[i] > z_max ? z[i] : z_max;
+
+    double sum = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < k; i++)
+        sum += exp(z[i] - z_max);
+
+    double log_sum = log(sum) + z_max;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif /* _OPENMP */
+    for (int i = 0; i < k; i++)
+        z[i] -= log_sum;
+
+    return log_sum;
+}
+
+/**
+\brief online log-sum-exp: merge k more terms into a running (max, sum about max)
+@param k number of new terms
+@param z the new terms
+@param running_max largest term so far (updated)
+@param running_sum sum of exp(term - running_max) so far (updated)
+*/
+GAUSSMIX_KERNEL
+void logSumExpMerge(int k, const double z[], double & running_max, double & running_sum)
+{
+    double z_max = running_max;
+#ifdef _OPENMP
+    #pragma omp simd reduction(max:z_max)
+#endif /* _OPENMP */
+    for (int i = 0; i < k; i++)
+        z_max = z[i] > z_max ? z[i] : z_max;
+
+    // rescale what has been summed so far to the new max, then add the new terms
+    double sum = (running_sum > 0.0) ? running_sum*exp(running_max - z_max) : 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:sum)
+#endif /* _OPENMP */
+    for (int i = 0; i < k; i++)
+        sum += exp(z[i] - z_max);
+
+    running_max = z_max;
+    running_sum = sum;
+}
+
+/**
+\brief weighted accumulation
+@param m length of the vectors
+@param w weight
+@param x vector
+@param acc accumulator, acc += w*x
+*/
+GAUSSMIX_KERNEL
+void weightedAccumulate(int m, double w, const double x[], double acc[])
+{
+#ifdef _OPENMP
+    #pragma omp simd
+#endif /* _OPENMP */
+    for (int i = 0; i < m; i++)
+        acc[i] += w * x[i];
+}
@@ -0,0 +1,99 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file Kernels.h
+*   \brief Vectorized inner loops of EM, kmeans and adaptation, dispatched on the CPU at run time
+*/
+#ifndef KERNELS_H
+#define KERNELS_H
+
+
+/*! \brief squared euclidean distance |a-b|^2
+@param m length of the vectors
+@param a vector
+@param b vector
+@return squared distance
+*/
+double squaredDistance(int m, const double a[], const double b[]);
+
+/*! \brief squared Mahalanobis distance |W*(x-mu)|^2 given a whitener W = inv(L), L the cholesky factor of the covariance
+@param m dimension
+@param W lower triangular whitener, column-major
+@param ld leading dimension of W
+@param x vector
+@param mu mean vector
+@return squared distance
+*/
+double mahalanobisWhitened(int m, const double W[], int ld, const double x[], const double mu[]);
+
+/*! \brief squared Mahalanobis distance |inv(L)*(x-mu)|^2 by forward substitution with the cholesky factor L
+@param m dimension
+@param L lower triangular cholesky factor of the covariance, column-major
+@param ld leading dimension of L
+@param x vector
+@param mu mean vector
+@return squared distance
+*/
+double mahalanobisSolve(int m, const double L[], int ld, const double x[], const double mu[]);
+
+/*! \brief log(sum(exp(z))), computed about max(z) so that it neither overflows nor underflows
+@param k number of terms (> 0)
+@param z the terms
+@return log of the sum of the exponentials
+*/
+double logSumExp(int k, const double z[]);
+
+/*! \brief in-place log-sum-exp normalization of one point's log weights: z -= log(sum(exp(z))).
+*   Max, exp-sum and normalization run back to back over the same (cache-resident) row.
+@param k number of terms (> 0)
+@param z the terms; on return, the log of each term's share of the total
+@return log of the sum of the exponentials of the terms as given
+*/
+double logNormalize(int k, double z[]);
+
+/*! \brief fold more terms into a running log-sum-exp, held as a max and the sum of exp(z - max) about it,
+*   so that log(sum(exp(z))) can be built up a few terms at a time. Start from max = -infinity, sum = 0;
+*   the total is then log(sum) + max.
+@param k number of new terms
+@param z the new terms
+@param[in,out] running_max largest term so far
+@param[in,out] running_sum sum of exp(term - running_max) so far
+*/
+void logSumExpMerge(int k, const double z[], double & running_max, double & running_sum);
+
+/*! \brief acc += w*x
+@param m length of the vectors
+@param w weight
+@param x vector
+@param acc accumulator
+*/
+void weightedAccumulate(int m, double w, const double x[], double acc[]);
+
+#endif //KERNELS_H
@@ -34,11 +34,19 @@
 #include <iomanip>
 #include <iostream>
 #include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstring>
 #include <omp.h>
 
+#include <cmath>
+
 #include <lapacke.h>
+#include <cblas.h>
 
 #include "Matrix.h"
+#include "AlignedAllocator.h"
+#include "Kernels.h"
 
 #define MATRIX_DEBUG 0
 
@@ -55,13 +63,35 @@ int cmIndex(int i, int j, int dim)
 }
 
 
+/** \brief allocate an aligned, zero-filled array of doubles
+* @param count number of doubles
+* @return the array (0 if count is 0). release with freeEntries()
+*/
+double * Matrix::allocEntries(std::size_t count)
+{
+    if (count == 0)
+        return 0;
+
+    void * mem = 0;
+    if (posix_memalign(&mem, GAUSSMIX_ALIGNMENT, count*sizeof(double)) != 0)
+        throw std::bad_alloc();
+    memset(mem, 0, count*sizeof(double));
+    return static_cast<double *>(mem);
+}
+
+/** \brief release an array obtained from allocEntries()
+* @param array the array (may be 0)
+*/
+void Matrix::freeEntries(double * array)
+{
+    free(array);
+}
+
 /** \brief Matrix create an empty matrix
 */
 Matrix::Matrix()
 { 
-
-    entries = new double[0];
-    changed = false;
+    entries = 0;
     numRows=0;
     numCols=0;
 }
@@ -74,22 +104,7 @@ Matrix::Matrix(int n, int m)
 {
     numRows=n;
     numCols=m;
-    entries = new double[n*m];
-    for (int i=0; i<n*m; i++)
-        entries[i] = 0;
-    changed = false;
-    for (int j=0; j<m; j++)
-    {
-
-        std::vector<double> temp;
-        columns.push_back(temp);
-
-        for (int i=0; i<n; i++)
-        {
-            columns[j].push_back(0);
-        }
-    }
-    
+    entries = allocEntries((std::size_t)n*m);
 }
 
 /** \brief Matrix Constructor to initialize matrix to 0's off-diagonal, and  a given vector on the diagonal (a la numpy.diag)
@@ -98,31 +113,11 @@ Matrix::Matrix(int n, int m)
 */
 Matrix::Matrix(double di[], int len)
 {
-    entries = new double[len*len];
-    changed = false;
-    int index=0;
-    for (int i=0; i<len; i++)
-    {
-        columns.push_back(std::vector<double>());
-    }
-    for (int i=0; i< len; i++)
-    {
-        for (int j=0; j<len; j++)
-        {
-            if (i==j) 
-            {
-                columns[j].insert(columns[j].begin() + i, di[i]);
-                entries[index++] = di[i];
-            }
-            else 
-            {
-                columns[j].insert(columns[j].begin() +i, 0);
-                entries[index++] = 0;
-            }
-        }
-    }
     numRows = len;
     numCols = len;
+    entries = allocEntries((std::size_t)len*len);
+    for (int i=0; i< len; i++)
+        entries[cmIndex(i, i, len)] = di[i];
 }
 
 /** \brief Matrix(double array, num rows, num cols, orientation)
@@ -136,33 +131,16 @@ Matrix::Matrix(double a[], int nRows, int nCols, Orientation major=COLUMN_MAJOR)
 {
     numRows = nRows;
     numCols = nCols;
-    changed = false;
-    for (int i=0; i<numCols; i++)
-    {
-        columns.push_back(std::vector<double>());
-    }
+    entries = allocEntries((std::size_t)numRows*numCols);
     if (major==COLUMN_MAJOR)
     {
-        entries = new double[numRows*numCols];
-        for (int k=0; k< numRows*numCols; k++)
-        {
-            entries[k] = a[k];
-            changed = false;
-            int j = k/numRows;
-            int i = k%numRows;
-            columns[j].insert(columns[j].begin() + i, a[k]);
-        }
+        memcpy(entries, a, (std::size_t)numRows*numCols*sizeof(double));
     }
     else if (major==ROW_MAJOR)
     {
-        entries = new double[0]; // will fill in later when needed
-        for (int k=0; k< numRows*numCols; k++)
-        {
-            changed = true;
-            int i = k/numCols;
-            int j = k%numCols;
-            columns[j].insert(columns[j].begin() + i, a[k]);
-        }
+        for (int i=0; i<numRows; i++)
+            for (int j=0; j<numCols; j++)
+                entries[cmIndex(i, j, numRows)] = a[i*numCols + j];
     }
 
 }
@@ -173,30 +151,80 @@ Create a matrix from its serialization
 */
 Matrix::Matrix(double *array)
 {
-    numRows = int(array[0]);
-    numCols = int(array[1]);
-    if (MATRIX_DEBUG) std::cout << "Creating array:from serialization: " << numRows <<" by "<<numCols<<std::endl;
-    if (MATRIX_DEBUG) std::cout << "Old columns size: "<<columns.size()<<std::endl;
-    entries = new double[0];
-    changed = true;
-    for (int i=0; i<numCols; i++)
+    entries = 0;
+    numRows = 0;
+    numCols = 0;
+    deSerialize(array);
+}
+
+/** \brief Matrix(const Matrix &) deep copy of another matrix
+@param other the matrix to copy
+*/
+Matrix::Matrix(const Matrix & other)
+{
+    numRows = other.numRows;
+    numCols = other.numCols;
+    entries = allocEntries((std::size_t)numRows*numCols);
+    if (entries)
+        memcpy(entries, other.entries, (std::size_t)numRows*numCols*sizeof(double));
+}
+
+/** \brief operator= replace this matrix with a deep copy of another
+@param other the matrix to copy
+@return ref to this matrix
+*/
+Matrix & Matrix::operator=(const Matrix & other)
+{
+    if (this != &other)
     {
-        //columns.push_back(std::vector<double>(numRows));
-        columns.push_back(std::vector<double>());
-        for (int j=0; j<numRows; j++)
-        {
-            //columns[i][j] = array[2+i*numRows+j];
-            columns[i].push_back(array[2+i*numRows+j]);
-        }
+        double * copy = allocEntries((std::size_t)other.numRows*other.numCols);
+        if (copy)
+            memcpy(copy, other.entries, (std::size_t)other.numRows*other.numCols*sizeof(double));
+        freeEntries(entries);
+        entries = copy;
+        numRows = other.numRows;
+        numCols = other.numCols;
     }
-    if (MATRIX_DEBUG) std::cout << "columns.size(): "<<columns.size()<<std::endl;
+    return *this;
+}
+
+/** \brief Matrix(Matrix &&) take over the storage of another matrix
+@param other the matrix to move from; left empty
+*/
+Matrix::Matrix(Matrix && other) noexcept
+{
+    entries = other.entries;
+    numRows = other.numRows;
+    numCols = other.numCols;
+    other.entries = 0;
+    other.numRows = 0;
+    other.numCols = 0;
+}
+
+/** \brief operator= take over the storage of another matrix
+@param other the matrix to move from; left empty
+@return ref to this matrix
+*/
+Matrix & Matrix::operator=(Matrix && other) noexcept
+{
+    if (this != &other)
+    {
+        freeEntries(entries);
+        entries = other.entries;
+        numRows = other.numRows;
+        numCols = other.numCols;
+        other.entries = 0;
+        other.numRows = 0;
+        other.numCols = 0;
+    }
+    return *this;
 }
 
 /** \Brief create a serialization of the matrix
 @param a array of row-major or column-major representation of matrix
 @return a serialization of the array
 */
-double * Matrix::Serialize()
+double * Matrix::Serialize() const
 {
     if (MATRIX_DEBUG)
         std::cout << "Serializing an array:" << numRows <<" by "<<numCols<<std::endl;
@@ -205,9 +233,9 @@ double * Matrix::Serialize()
     out[0] = float(numRows);
     out[1] = float(numCols);
 
-    for (int i=0; i<numCols; i++)
-        for (int j=0; j<numRows; j++)
-            out[2+i*numRows+j] = columns[i][j];
+    // serialization body is the column-major array itself
+    if (entries)
+        memcpy(out+2, entries, (std::size_t)numRows*numCols*sizeof(double));
     return out;
 }
 /** \brief Matrix(double array)
@@ -216,36 +244,20 @@ Fill a matrix from a Matrix serialization
 */
 void Matrix::deSerialize(double *array)
 {
-    numRows = int(array[0]);
-    numCols = int(array[1]);
-    if (MATRIX_DEBUG) std::cout << "Deserializing an array:" << numRows <<" by "<<numCols<<std::endl;
-    if (MATRIX_DEBUG) std::cout << "Old columns size: "<<columns.size()<<std::endl;
-    //entries = new double[0];
-    changed = true;
-    // Fresh start
-    columns.resize(0);
-    for (int i=0; i<numCols; i++)
+    int rows = int(array[0]);
+    int cols = int(array[1]);
+    if (MATRIX_DEBUG) std::cout << "Deserializing an array:" << rows <<" by "<<cols<<std::endl;
+
+    // Fresh start, unless the shape is unchanged
+    if (rows*cols != numRows*numCols)
     {
-        columns.push_back(std::vector<double>(numRows));
-        //columns.push_back(std::vector<double>());
-        for (int j=0; j<numRows; j++)
-        {
-            columns[i][j] = array[2+i*numRows+j];
-            //columns[i].push_back(array[2+i*numRows+j]);
-        }
+        freeEntries(entries);
+        entries = allocEntries((std::size_t)rows*cols);
     }
-    if (MATRIX_DEBUG) std::cout << "columns.size(): "<<columns.size()<<std::endl;
-}
-
-/** \brief get value of matrix element
-@param i the 0-rel row number
-@param j the 0-rel column number
-@return the element in ith row, jth column (indexed from 0)
-*/
-double Matrix::getValue(int i, int j) const
-{
-    std::vector<double> col = columns[j];
-    return col[i];
+    numRows = rows;
+    numCols = cols;
+    if (entries)
+        memcpy(entries, array+2, (std::size_t)numRows*numCols*sizeof(double));
 }
 
 /**
@@ -276,29 +288,9 @@ void Matrix::assign(double val, int i, int j)
 {
     if (j>=numCols || j<0) throw SizeError((char *)"Error: attempt to assign value to a non-existent column");
     if (i>=numRows || i<0) throw SizeError((char *)"Error: attempt to assign value to a non-existent row");
-    columns[j].insert(columns[j].begin() + i, val);
-    changed = true;
+    entries[cmIndex(i, j, numRows)] = val;
 }
 
-/** \brief Overwrite val in the ith row, jth column of the matrix
-@param val double value to write
-@param i 0-rel row number
-@param j 0-rel column number
-*/
-void Matrix::update(double val, int i, int j) 
-{
-    if (j>=numCols || j<0) 
-        {
-        throw SizeError((char *)"Error: attempt to write value to a non-existent column");
-        }
-    if (i>=numRows || i<0) throw SizeError((char *)"Error: attempt to write value to a non-existent row");
-    columns[j][i] = val;
-    changed = true; 
-}
-
-
-
-
 /**
 \brief Insert row as the rowNum'th row in the matrix (indexed from 0)
 @param row the row to insert 
@@ -321,23 +313,21 @@ Matrix & Matrix::insertRow(double * row, int rowSize, int rowNum) throw (SizeErr
     }
 
     if (numCols == 0)
-    {
-        // need to first create empty column entries
-        for (int i = 0; i < rowSize; i++)
-        {
-            columns.push_back(std::vector<double>());
-        }
         numCols = rowSize;
-    }
-    for (int i=0; i<rowSize; i++)
-    {
 
-        std::vector<double> & col = columns[i];
-        std::vector<double>::iterator iter = col.begin();
-        col.insert(iter+rowNum, row[i]);
+    // every column grows by one, so the whole column-major array must be re-laid out
+    double * grown = allocEntries((std::size_t)(numRows+1)*numCols);
+    for (int j=0; j<numCols; j++)
+    {
+        const double * src = entries + (std::size_t)j*numRows;
+        double * dst = grown + (std::size_t)j*(numRows+1);
+        memcpy(dst, src, rowNum*sizeof(double));
+        dst[rowNum] = row[j];
+        memcpy(dst+rowNum+1, src+rowNum, (numRows-rowNum)*sizeof(double));
     }
+    freeEntries(entries);
+    entries = grown;
     numRows++;
-    changed = true;
 
     return *this;
 }
@@ -365,11 +355,18 @@ Matrix & Matrix::insertColumn(double * col, int colSize, int colNum) throw (Size
     }
 
     if (numRows==0) numRows = colSize;
-    std::vector<double> newCol(col, col+colSize);
-    columns.insert(columns.begin() + colNum, newCol);
-    
+
+    // columns are contiguous, so the new one is spliced in between the old ones
+    double * grown = allocEntries((std::size_t)numRows*(numCols+1));
+    if (colNum > 0)
+        memcpy(grown, entries, (std::size_t)colNum*numRows*sizeof(double));
+    memcpy(grown + (std::size_t)colNum*numRows, col, numRows*sizeof(double));
+    if (numCols > colNum)
+        memcpy(grown + (std::size_t)(colNum+1)*numRows, entries + (std::size_t)colNum*numRows,
+               (std::size_t)(numCols-colNum)*numRows*sizeof(double));
+    freeEntries(entries);
+    entries = grown;
     numCols++;
-    changed = true;
 
     return *this;
 }
@@ -379,13 +376,13 @@ Matrix & Matrix::insertColumn(double * col, int colSize, int colNum) throw (Size
 @param rowOffset number of the row to retrieve (indexed from 0)
 @param vec empty  vector in whuch to return row data
 @return ref to vector representation of the specified row*/
-std::vector<double> & Matrix::getCopyOfRow(int rowOffset,std::vector<double> & vec) throw (SizeError)
+std::vector<double> & Matrix::getCopyOfRow(int rowOffset,std::vector<double> & vec) const throw (SizeError)
 {
-    if (rowOffset<0 || rowOffset > numRows)
+    if (rowOffset<0 || rowOffset >= numRows)
         throw SizeError((char*)"Error: attempted to get copy of non-existent row");
 
     for (int j=0; j<numCols; j++)
-        vec.push_back(columns[j][rowOffset]);
+        vec.push_back(entries[cmIndex(rowOffset, j, numRows)]);
     return vec;
 }
 
@@ -393,15 +390,13 @@ std::vector<double> & Matrix::getCopyOfRow(int rowOffset,std::vector<double> & v
 @param colOffset number of the column to retrieve (indexed from 0)
 @param vec empty  vector in whuch to return row data
 @return ref to vector representation of the specified column*/
-std::vector<double> & Matrix::getCopyOfColumn(int colOffset, std::vector<double> & vec) throw (SizeError)
+std::vector<double> & Matrix::getCopyOfColumn(int colOffset, std::vector<double> & vec) const throw (SizeError)
 {
-    if (colOffset<0 || colOffset > numCols)
+    if (colOffset<0 || colOffset >= numCols)
         throw SizeError((char*)"Error: attempted to get copy of non-existent column");
 
-    for (int i=0; i<numRows; i++)
-    {
-        vec.push_back(columns[colOffset][i]);
-    }
+    const double * col = entries + (std::size_t)colOffset*numRows;
+    vec.insert(vec.end(), col, col+numRows);
     return vec;
 }
 
@@ -418,22 +413,18 @@ lapack_logical leq(const double* a, const double* b)
 * \brief det
 @return the determinant. Note: only works for square matrices
 */
-double Matrix::det() throw (LapackError, SizeError)
+double Matrix::det() const throw (LapackError, SizeError)
 {
 
 
     if (numRows!=numCols) throw SizeError((char *)"Attempt to compute determinant of a non-square matrix");
-    updateArray(); // update column-major array representation of the matrix, to include any recent changes
     char JOBVS = 'N'; // don't need Schur vectors
     char SORT ='N'; // don't need eigenvalues ordered
     LAPACK_D_SELECT2 SELECT= &leq;     // not referenced if SORT == 'N'
     lapack_int N=numRows; 
     // make a copy of entries, as LAPACK will overwrite
     double* A = new double[N*N];
-    for (int i=0; i<N*N; i++)
-    {
-        A[i] = entries[i];
-    }
+    memcpy(A, entries, (std::size_t)N*N*sizeof(double));
     int LDA=N;
     lapack_int SDIM; // output
     double *WR, *WI, *VS; // output (VS should not be referenced if JOBVS =='N')
@@ -446,7 +437,14 @@ double Matrix::det() throw (LapackError, SizeError)
 
     // get the eigenvalues from LAPACKE
     int code = LAPACKE_dgees(LAPACK_COL_MAJOR, JOBVS, SORT, SELECT, N, A, LDA, &SDIM, WR, WI, VS, LDVS);
-    if (code!=0) {throw LapackError((char*)"failed to get eigenvalues through LAPACKE_dgees");}
+    if (code!=0)
+    {
+        delete[] A;
+        delete[] WR;
+        delete[] WI;
+        delete[] VS;
+        throw LapackError((char*)"failed to get eigenvalues through LAPACKE_dgees");
+    }
 
     // now WR holds the real portion of our eigenvalues, WI the imaginary portion
 
@@ -472,118 +470,396 @@ double Matrix::det() throw (LapackError, SizeError)
 
 
 /**
-\brief Matrix multiplication this*B
-@param B matrix to multiply by
-@return product of matrix multiplication: this*B. caller must delete.
+* \brief cholesky factor a symmetric positive definite matrix
+@return the factorization (only the lower triangle of this matrix is read)
 */
-Matrix * Matrix::dot(const Matrix& B) const
+Cholesky Matrix::cholesky() const throw (SizeError, LapackError)
 {
-    
-    if (numCols!=B.rowCount()) throw SizeError((char*)"Error: Attempted to multiply matrices with mismatched sizes");
-    int cols1 = numCols;
-    int rows1 = numRows;
-    int cols2 = B.colCount();
-    double* result = new double[rows1*cols2];
-    for (int i=0; i<rows1; i++)
+    return Cholesky(*this);
+}
+
+/**
+* \brief Cholesky create an empty factorization
+*/
+Cholesky::Cholesky()
+{
+    logDeterminant = 0.0;
+}
+
+/**
+* \brief Cholesky factor A = L*L'
+@param A symmetric positive definite matrix (only the lower triangle is read)
+*/
+Cholesky::Cholesky(const Matrix & A) throw (SizeError, LapackError)
+    : L(A)
+{
+    if (A.rowCount()!=A.colCount())
+        throw SizeError((char *)"Error: tried to Cholesky-factor a non-square matrix");
+
+    int dim = A.rowCount();
+    double * l = L.getArray();
+    lapack_int code = LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'L', dim, l, dim);
+    if (code!=0)
+        throw LapackError((char*)"Error in Cholesky factorization in Matrix::cholesky--matrix is not positive definite");
+
+    // dpotrf leaves the strict upper triangle untouched; clear it so L is a proper factor
+    logDeterminant = 0.0;
+    for (int j=0; j<dim; j++)
     {
-        for (int j=0; j<cols2; j++)
-        {
-            double sum=0;
-            for (int k=0; k<cols1; k++)
-            {
-                sum+=getValue(i, k)*B.getValue(k, j);
-            }    
-            result[cmIndex(i, j, rows1)] = sum;
-        }
+        for (int i=0; i<j; i++)
+            l[cmIndex(i, j, dim)] = 0.0;
+        logDeterminant += 2.0*log(l[cmIndex(j, j, dim)]);
     }
+}
 
-    Matrix* R = new Matrix(result, rows1, cols2);
-    delete[] result;
-    return R;
+/**
+* \brief dimension of the factored matrix
+*/
+int Cholesky::dimension() const
+{
+    return L.rowCount();
 }
 
-/** \brief Subtract Matrix B from this Matrix
-    @param B Matrix to subtract from this. caller must delete.
+/**
+* \brief log of the determinant of the factored matrix
 */
-Matrix* Matrix::subtract(const Matrix& B) const
+double Cholesky::logdet() const
 {
-    if ( (numRows!=B.rowCount())|| (numCols!=B.colCount()) ) 
-        throw SizeError((char*)"Error: Attempted to subtract matrices with mismatched sizes");
+    return logDeterminant;
+}
 
-    double * result = new double[numRows*numCols];
-    for (int i=0; i<numRows; i++)
-        for (int j=0; j<numCols; j++)
-            result[cmIndex(i, j, numRows)] = getValue(i,j) - B.getValue(i,j);
+/**
+* \brief the lower triangular factor
+*/
+const Matrix & Cholesky::factor() const
+{
+    return L;
+}
 
-    Matrix* R = new Matrix(result, numRows, numCols);
-    delete[] result;
-    return R;
+/**
+* \brief the whitening matrix inv(L)
+@return inv(L), lower triangular
+*/
+Matrix Cholesky::whitener() const throw (LapackError)
+{
+    Matrix W(L);
+    int dim = W.rowCount();
+    if (dim==0)
+        return W;
+    lapack_int code = LAPACKE_dtrtri(LAPACK_COL_MAJOR, 'L', 'N', dim, W.getArray(), dim);
+    if (code!=0)
+        throw LapackError((char*)"Error in triangular inversion in Cholesky::whitener");
+    return W;
+}
+
+/**
+* \brief solve A*x = b in place, with two triangular solves
+@param b right hand side in, solution out
+*/
+void Cholesky::solve(double b[]) const
+{
+    int dim = L.rowCount();
+    cblas_dtrsv(CblasColMajor, CblasLower, CblasNoTrans, CblasNonUnit, dim, L.getArray(), dim, b, 1);
+    cblas_dtrsv(CblasColMajor, CblasLower, CblasTrans, CblasNonUnit, dim, L.getArray(), dim, b, 1);
+}
+
+/**
+* \brief Mahalanobis distance x' * inv(A) * x = |inv(L)*x|^2
+@param x vector
+@return squared distance
+*/
+double Cholesky::mahalanobis(const double x[]) const
+{
+    int dim = L.rowCount();
+    double z[dim];
+    memcpy(z, x, dim*sizeof(double));
+    cblas_dtrsv(CblasColMajor, CblasLower, CblasNoTrans, CblasNonUnit, dim, L.getArray(), dim, z, 1);
+    return cblas_ddot(dim, z, 1, z, 1);
 }
 
+/**
+* \brief Mahalanobis distance (x-mu)' * inv(A) * (x-mu)
+@param x vector
+@param mu mean vector
+@return squared distance
+*/
+double Cholesky::mahalanobis(const double x[], const double mu[]) const
+{
+    int dim = L.rowCount();
+    return mahalanobisSolve(dim, L.getArray(), dim, x, mu);
+}
 
-/** 
-\brief matrix multiplication for matrices already represented in column-major form
-@param A col-major matrix
-@param B col-major matrix
-@param rows1 rows for A, cols for B
-@param cols1 cols for A
-@param cols2 cols for B
-@param[out] result column-major result array (caller allocates)
+/**
+\brief factor a batch of covariance matrices in parallel into contiguous whiteners and log normalizers
+@param A the k matrices to factor
 */
-void Matrix::dot(double A[], double B[], int rows1, int cols1, int cols2, double result[])
+CholeskyBatch::CholeskyBatch(const std::vector<Matrix *> & A) throw (SizeError, LapackError)
 {
-    for (int i=0; i<rows1; i++)
+    int k = A.size();
+    dim = (k>0) ? A[0]->rowCount() : 0;
+    for (int g=0; g<k; g++)
+        if (A[g]->rowCount()!=dim || A[g]->colCount()!=dim)
+            throw SizeError((char *)"Error: tried to batch-factor matrices that are not square and of one size");
+
+    // each whitener is dim columns of lead (>= dim) doubles, so every column starts aligned
+    lead = paddedLeadingDimension(dim);
+    std::size_t stride = (std::size_t)lead*dim;
+    whitenerArray.assign(stride*k, 0.0);
+    logDeterminants.assign(k, 0.0);
+    logNorms.assign(k, 0.0);
+
+    // errors can't be thrown out of a parallel region; note the first one and throw afterwards
+    const char * error = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif /* _OPENMP */
+    for (int g=0; g<k; g++)
     {
-        for (int j=0; j<cols2; j++)
+        // factor and invert in the component's own slot of the contiguous array
+        double * w = &whitenerArray[g*stride];
+        const double * a = A[g]->getArray();
+        for (int j=0; j<dim; j++)
+            memcpy(w + (std::size_t)j*lead, a + (std::size_t)j*dim, dim*sizeof(double));
+
+        lapack_int code = (dim>0) ? LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'L', dim, w, lead) : 0;
+        double logdet = 0.0;
+        if (code==0)
         {
-            double sum=0;
-            for (int k=0; k<cols1; k++)
+            // clear the strict upper triangle dpotrf leaves behind, then invert L in place
+            for (int j=0; j<dim; j++)
             {
-                sum+=A[cmIndex(i, k, rows1)]*B[cmIndex(k, j, cols1)];
-            }    
-            result[cmIndex(i, j, rows1)] = sum;
+                for (int i=0; i<j; i++)
+                    w[cmIndex(i, j, lead)] = 0.0;
+                logdet += 2.0*log(w[cmIndex(j, j, lead)]);
+            }
+            if (dim>0)
+                code = LAPACKE_dtrtri(LAPACK_COL_MAJOR, 'L', 'N', dim, w, lead);
+        }
+        if (code!=0)
+        {
+#ifdef _OPENMP
+            #pragma omp critical(cholesky_batch_error)
+#endif /* _OPENMP */
+            if (!error)
+                error = "Error in Cholesky factorization in CholeskyBatch--matrix is not positive definite";
+            continue;
         }
+
+        logDeterminants[g] = logdet;
+        logNorms[g] = -0.5*( dim*log(2.0*M_PI) + logdet );
     }
+
+    if (error)
+        throw LapackError(error);
+}
+
+/**
+\brief squared Mahalanobis distance |inv(L_g)*(x-mu)|^2
+@param g 0-rel index of a matrix in the batch
+@param x vector
+@param mu vector
+@return squared distance
+*/
+double CholeskyBatch::mahalanobis(int g, const double x[], const double mu[]) const
+{
+    return mahalanobisWhitened(dim, whitener(g), lead, x, mu);
+}
+
+/**
+\brief squared Mahalanobis distances of a block of points, d[i] = |inv(L_g)*(x_i-mu)|^2
+@param g 0-rel index of a matrix in the batch
+@param count number of points
+@param X count x dim column-major block of points
+@param ldx leading dimension of X
+@param mu vector
+@param work count*dim scratch
+@param d output distances
+*/
+void CholeskyBatch::mahalanobisBlock(int g, int count, const double X[], int ldx, const double mu[],
+        double work[], double d[]) const
+{
+    for (int i=0; i<count; i++)
+        d[i] = 0.0;
+    if (count<=0 || dim<=0)
+        return;
+
+    // center the block, one point per row: work = X - 1*mu'
+    for (int j=0; j<dim; j++)
+    {
+        const double * x = X + (std::size_t)j*ldx;
+        double * c = work + (std::size_t)j*count;
+        double mu_j = mu[j];
+        for (int i=0; i<count; i++)
+            c[i] = x[i] - mu_j;
+    }
+
+    // whiten every point at once: each row (x-mu)' becomes (x-mu)'*inv(L)'
+    cblas_dtrmm(CblasColMajor, CblasRight, CblasLower, CblasTrans, CblasNonUnit, count, dim, 1.0,
+            whitener(g), lead, work, count);
+
+    // squared row norms, a column at a time so the inner loop is unit stride
+    for (int j=0; j<dim; j++)
+    {
+        const double * c = work + (std::size_t)j*count;
+        for (int i=0; i<count; i++)
+            d[i] += c[i]*c[i];
+    }
+}
+
+/**
+\brief Matrix multiplication this*B
+@param B matrix to multiply by
+@return product of matrix multiplication: this*B
+*/
+Matrix Matrix::dot(const Matrix& B) const
+{
+    
+    if (numCols!=B.rowCount()) throw SizeError((char*)"Error: Attempted to multiply matrices with mismatched sizes");
+
+    Matrix R(numRows, B.colCount());
+    gemm(1.0, *this, NO_TRANSPOSE, B, NO_TRANSPOSE, 0.0, R);
+    return R;
+}
+
+/**
+\brief general matrix multiply into a caller-provided matrix: C = alpha*op(A)*op(B) + beta*C
+@param alpha scalar multiplier of the product
+@param A left operand
+@param transA transpose A?
+@param B right operand
+@param transB transpose B?
+@param beta scalar multiplier of C
+@param C output (already sized)
+*/
+void Matrix::gemm(double alpha, const Matrix & A, Transpose transA, const Matrix & B, Transpose transB,
+        double beta, Matrix & C) throw (SizeError)
+{
+    int m = (transA==NO_TRANSPOSE) ? A.numRows : A.numCols;
+    int k = (transA==NO_TRANSPOSE) ? A.numCols : A.numRows;
+    int kb = (transB==NO_TRANSPOSE) ? B.numRows : B.numCols;
+    int n = (transB==NO_TRANSPOSE) ? B.numCols : B.numRows;
+    if (k!=kb || C.numRows!=m || C.numCols!=n)
+        throw SizeError((char*)"Error: Attempted to multiply matrices with mismatched sizes");
+    if (m==0 || n==0)
+        return;
+
+    cblas_dgemm(CblasColMajor, (transA==NO_TRANSPOSE) ? CblasNoTrans : CblasTrans,
+                (transB==NO_TRANSPOSE) ? CblasNoTrans : CblasTrans,
+                m, n, k, alpha, A.entries, (A.numRows>0 ? A.numRows : 1), B.entries, (B.numRows>0 ? B.numRows : 1),
+                beta, C.entries, m);
+}
+
+/**
+\brief general matrix-vector multiply into a caller-provided vector: y = alpha*op(A)*x + beta*y
+@param alpha scalar multiplier of the product
+@param A matrix operand
+@param transA transpose A?
+@param x input vector
+@param beta scalar multiplier of y
+@param y output vector
+*/
+void Matrix::gemv(double alpha, const Matrix & A, Transpose transA, const double x[], double beta, double y[])
+{
+    if (A.numRows==0 || A.numCols==0)
+        return;
+    cblas_dgemv(CblasColMajor, (transA==NO_TRANSPOSE) ? CblasNoTrans : CblasTrans,
+                A.numRows, A.numCols, alpha, A.entries, A.numRows, x, 1, beta, y, 1);
+}
+
+/**
+\brief symmetric rank-1 update of the lower triangle: C += alpha*x*x'
+@param alpha scalar multiplier
+@param x vector
+@param C square matrix updated in place
+*/
+void Matrix::syr(double alpha, const double x[], Matrix & C) throw (SizeError)
+{
+    if (C.numRows!=C.numCols)
+        throw SizeError((char*)"Error: Attempted a symmetric update of a non-square matrix");
+    if (C.numRows==0)
+        return;
+    cblas_dsyr(CblasColMajor, CblasLower, C.numRows, alpha, x, 1, C.entries, C.numRows);
+}
+
+/**
+\brief symmetric rank-k update of the lower triangle: C = alpha*op(A)*op(A)' + beta*C
+@param alpha scalar multiplier of the product
+@param A operand
+@param transA transpose A?
+@param beta scalar multiplier of C
+@param C square matrix updated in place
+*/
+void Matrix::syrk(double alpha, const Matrix & A, Transpose transA, double beta, Matrix & C) throw (SizeError)
+{
+    int n = (transA==NO_TRANSPOSE) ? A.numRows : A.numCols;
+    int k = (transA==NO_TRANSPOSE) ? A.numCols : A.numRows;
+    if (C.numRows!=n || C.numCols!=n)
+        throw SizeError((char*)"Error: Attempted a symmetric update with mismatched sizes");
+    if (n==0)
+        return;
+    cblas_dsyrk(CblasColMajor, CblasLower, (transA==NO_TRANSPOSE) ? CblasNoTrans : CblasTrans,
+                n, k, alpha, A.entries, (A.numRows>0 ? A.numRows : 1), beta, C.entries, n);
+}
+
+/**
+\brief copy the lower triangle over the upper triangle
+*/
+void Matrix::symmetrize() throw (SizeError)
+{
+    if (numRows!=numCols)
+        throw SizeError((char*)"Error: Attempted to symmetrize a non-square matrix");
+    for (int j=1; j<numCols; j++)
+        for (int i=0; i<j; i++)
+            entries[cmIndex(i, j, numRows)] = entries[cmIndex(j, i, numRows)];
 }
 
+/** \brief Subtract Matrix B from this Matrix
+    @param B Matrix to subtract from this
+    @return the difference this-B
+*/
+Matrix Matrix::subtract(const Matrix& B) const
+{
+    if ( (numRows!=B.rowCount())|| (numCols!=B.colCount()) ) 
+        throw SizeError((char*)"Error: Attempted to subtract matrices with mismatched sizes");
+
+    Matrix R(numRows, numCols);
+    std::size_t count = (std::size_t)numRows*numCols;
+    for (std::size_t i=0; i<count; i++)
+        R.entries[i] = entries[i] - B.entries[i];
+
+    return R;
+}
+
+
 /**
 \brief Invert the matrix
-@return the inverse of this matrix. caller deletes.
+@return the inverse of this matrix
 */
-Matrix* Matrix::inv() throw (SizeError, LapackError)
+Matrix Matrix::inv() const throw (SizeError, LapackError)
 {
     if (numRows!=numCols)
         throw SizeError((char *)"Error: tried to invert a non-square matrix");
 
     int dim = numRows;
-    updateArray();
-    double* result = new double[dim*dim];
-    // copy matrixArray into result, as it's going to get overwritten 
-    for (int i=0; i<dim*dim; i++)
-        result[i] = entries[i];
+    // factor and invert a copy, as it's going to get overwritten
+    Matrix R(*this);
 
     lapack_int lda=dim;
     lapack_int* ipiv = new lapack_int[dim];
     // put result in LU form
-    lapack_int code = LAPACKE_dgetrf(LAPACK_COL_MAJOR, dim, dim, result, lda, ipiv );
+    lapack_int code = LAPACKE_dgetrf(LAPACK_COL_MAJOR, dim, dim, R.entries, lda, ipiv );
     if (code!=0)
     {
         delete[] ipiv;
-        delete[] result;
         throw LapackError((char*)"ERROR in LU factorization in Matrix::inv"); 
     }
 
     // use LU form to find inverse, put in result
-    code = LAPACKE_dgetri(LAPACK_COL_MAJOR, dim, result, lda, ipiv);
+    code = LAPACKE_dgetri(LAPACK_COL_MAJOR, dim, R.entries, lda, ipiv);
     delete[] ipiv;
     if (code!=0)
-    {
-        delete[] result;
         throw LapackError((char*)"Error in inversion in Matrix::inv"); 
-    }
 
-    Matrix* R = new Matrix(result, dim, dim);
-    delete[] result;
     return R;
 }
 
@@ -598,11 +874,12 @@ void Matrix::add(double vector[], int m, int axis)
     if (axis==0)
     {
         if (numCols!=m){throw SizeError((char*)"Error in Matrix::add: row size doesn't match number of columns in matrix.");}
-        for (int i=0; i<numRows; i++) // ith row
+        for (int j=0; j<numCols; j++) // jth column
         {
-            for (int j=0; j<numCols; j++) // jth column
+            double * col = entries + (std::size_t)j*numRows;
+            for (int i=0; i<numRows; i++) // ith row
             {
-                columns[j][i] = columns[j][i] + vector[j];
+                col[i] += vector[j];
             }
         }
     }
@@ -611,9 +888,10 @@ void Matrix::add(double vector[], int m, int axis)
         if (numRows!=m) {throw SizeError((char*)"Error in Matrix::add: column size doesn't match number of rows in matrix");}
         for (int j=0; j<numCols; j++) // jth column
         {    
+            double * col = entries + (std::size_t)j*numRows;
             for (int i=0; i<numRows; i++) // ith row
             {
-                columns[j][i] = columns[j][i] + vector[i]; 
+                col[i] += vector[i]; 
             }
         }
     }
@@ -638,30 +916,10 @@ void Matrix::subtract(double vector[], int m, int axis)
     delete[] neg;
 }
 
-/**
-\brief update the column-major array representation of matrix, in case the matrix has changed since it was last computed
-*/
-void Matrix::updateArray() 
-{
-    if (changed)
-    {    
-        delete[] entries;
-        entries = new double[numRows*numCols];
-        for (int j=0; j< numCols; j++)
-        {
-            for (int i=0; i<numRows; i++)
-            {
-                entries[j*numRows+i] = columns[j][i];
-            }
-        }
-        changed=false;
-    }
-}
-
 /**
 \brief Print out the matrix
 */
-void Matrix::print()
+void Matrix::print() const
 {
   std::ostringstream sout;
   sout << std::setprecision(7);
@@ -674,7 +932,7 @@ void Matrix::print()
     for (int i=0; i<numRows; i++)
     {
         for (int j=0; j<numCols; j++)
-            sout << ' ' << columns[j][i];
+            sout << ' ' << entries[cmIndex(i, j, numRows)];
     sout << std::endl;
     }
     sout << "--------------------------------------" << std::endl;
@@ -684,8 +942,7 @@ void Matrix::print()
 
 Matrix::~Matrix()
 {
-    if( 1 > this->columns.size() )
-        delete[] entries;
+    freeEntries(entries);
 }
 
 /**
@@ -694,11 +951,8 @@ Matrix::~Matrix()
 void Matrix::clear()
 {
 
-    this->columns.clear();
-
-    delete[] entries;
-    entries = new double[0];
-    changed = true;
+    freeEntries(entries);
+    entries = 0;
     numRows=0;
     numCols=0;
 }
@@ -36,7 +36,9 @@
 #include <string>
 #include <exception>
 #include <stdexcept>
+#include <cstddef>
 
+#include "AlignedAllocator.h"
 
 //! class for returning errors due to mismatched size in matrix operations */
 class SizeError: public std::runtime_error
@@ -54,12 +56,17 @@ class LapackError: public std::runtime_error
 };
 
 
+class Cholesky;
+
 class Matrix
 {
 	public:
 	/** enum for specifying how a matrix is represented as an array - used for matrix constructor*/
 	enum Orientation{ROW_MAJOR, COLUMN_MAJOR };
 
+	/** enum for specifying whether an operand of a blas routine is used as is, or transposed*/
+	enum Transpose{NO_TRANSPOSE, TRANSPOSE };
+
 	/**create an empty matrix (size 0x0) */
 	Matrix();
 
@@ -85,11 +92,29 @@ class Matrix
 	*/
 	Matrix(double *array);
 
+	/** Create a deep copy of another matrix
+	@param other matrix to copy*/
+	Matrix(const Matrix & other);
+
+	/** Replace the contents of this matrix with a deep copy of another
+	@param other matrix to copy
+	@return ref to this matrix*/
+	Matrix & operator=(const Matrix & other);
+
+	/** Take over the storage of another matrix without copying
+	@param other matrix to move from; left as an empty 0x0 matrix*/
+	Matrix(Matrix && other) noexcept;
+
+	/** Replace the contents of this matrix by taking over the storage of another
+	@param other matrix to move from; left as an empty 0x0 matrix
+	@return ref to this matrix*/
+	Matrix & operator=(Matrix && other) noexcept;
+
 	/** Create a serialization of the matrix
 	    @param a array of row-major or column-major representation of matrix
 	    @return a serialization of the array
 	*/
-	double * Serialize();
+	double * Serialize() const;
 
         /** \brief Matrix(double array)
 	    Fill a matrix from a Matrix serialization
@@ -136,29 +161,83 @@ class Matrix
 	/**@return the element in ith row, jth column (indexed from 0)*/
 	double getValue(int row, int column) const;
 
+	/**@return the underlying column-major array (rowCount() x colCount(), leading dimension rowCount()),
+	or 0 for an empty matrix. Only valid until the matrix is resized.*/
+	double * getArray();
+
+	/**@return the underlying column-major array (read-only)*/
+	const double * getArray() const;
+
 	/**Invert the matrix
 	@return the inverse of this matrix*/
-	Matrix * inv() throw (SizeError, LapackError);
+	Matrix inv() const throw (SizeError, LapackError);
 
 	/**Matrix multiplication -- this*B
 	@param B matrix to multiply by
 	@return product of matrix multiplication: this*B  */
-	Matrix * dot(const Matrix& m) const;
+	Matrix dot(const Matrix& m) const;
+
+	/**General matrix multiply, written into a caller-provided matrix (blas dgemm):
+	C = alpha*op(A)*op(B) + beta*C
+	@param alpha scalar multiplier of the product
+	@param A left operand
+	@param transA whether op(A) is A or A'
+	@param B right operand
+	@param transB whether op(B) is B or B'
+	@param beta scalar multiplier of C (0 to overwrite C)
+	@param C output matrix, already sized op(A).rowCount() x op(B).colCount()*/
+	static void gemm(double alpha, const Matrix & A, Transpose transA, const Matrix & B, Transpose transB,
+			double beta, Matrix & C) throw (SizeError);
+
+	/**General matrix-vector multiply, written into a caller-provided vector (blas dgemv):
+	y = alpha*op(A)*x + beta*y
+	@param alpha scalar multiplier of the product
+	@param A matrix operand
+	@param transA whether op(A) is A or A'
+	@param x vector of length op(A).colCount()
+	@param beta scalar multiplier of y (0 to overwrite y)
+	@param y output vector of length op(A).rowCount()*/
+	static void gemv(double alpha, const Matrix & A, Transpose transA, const double x[], double beta, double y[]);
+
+	/**Symmetric rank-1 update, in place (blas dsyr): C += alpha*x*x'.
+	Only the lower triangle of C is updated; call symmetrize() once accumulation is done.
+	@param alpha scalar multiplier
+	@param x vector of length C.rowCount()
+	@param C square output matrix*/
+	static void syr(double alpha, const double x[], Matrix & C) throw (SizeError);
+
+	/**Symmetric rank-k update, in place (blas dsyrk): C = alpha*op(A)*op(A)' + beta*C.
+	Only the lower triangle of C is updated; call symmetrize() once accumulation is done.
+	@param alpha scalar multiplier of the product
+	@param A operand
+	@param transA whether op(A) is A (C += A*A') or A' (C += A'*A)
+	@param beta scalar multiplier of C (0 to overwrite C)
+	@param C square output matrix, already sized op(A).rowCount() x op(A).rowCount()*/
+	static void syrk(double alpha, const Matrix & A, Transpose transA, double beta, Matrix & C) throw (SizeError);
+
+	/**Copy the lower triangle of a square matrix over its upper triangle*/
+	void symmetrize() throw (SizeError);
 
 	/**@return the determinant. Note: only works for square matrices*/
-	double det() throw (LapackError, SizeError);
+	double det() const throw (LapackError, SizeError);
+
+	/**Cholesky-factor a symmetric positive definite matrix (only the lower triangle is read).
+	This is much cheaper than inv() plus det(), and is the preferred way to work with covariances.
+	@return the factorization
+	@throw LapackError if the matrix is not positive definite*/
+	Cholesky cholesky() const throw (SizeError, LapackError);
 
 	/**return a copy of rowOffset'th row of the matrix
 	@param rowOffset number of the row to retrieve (indexed from 0)
 	@param vec empty  vector in whuch to return row data
 	@return ref to vector representation of the specified row*/
-	std::vector<double> & getCopyOfRow(int rowOffset,std::vector<double> & vec) throw (SizeError);
+	std::vector<double> & getCopyOfRow(int rowOffset,std::vector<double> & vec) const throw (SizeError);
 
 	/** return a copy of colOffset'th row of the matrix
 	@param colOffset number of the column to retrieve (indexed from 0)
 	@param vec empty  vector in whuch to return row data
 	@return ref to vector representation of the specified column*/
-	std::vector<double> & getCopyOfColumn(int colOffset, std::vector<double> & vec) throw (SizeError);
+	std::vector<double> & getCopyOfColumn(int colOffset, std::vector<double> & vec) const throw (SizeError);
 
 	/**  Add vector to matrix row by row or column by column (in place)
 	@param vector array to add
@@ -167,8 +246,9 @@ class Matrix
 	void add(double vector[], int m, int axis);
 
 	/** Subtract Matrix B from this Matrix 
-	@param B Matrix to subtract from this*/
-	Matrix* subtract(const Matrix& B) const;
+	@param B Matrix to subtract from this
+	@return the difference this-B*/
+	Matrix subtract(const Matrix& B) const;
 
 	/**  Subtract vector from matrix row by row or column by column (in place)
 	@param vector array to subtract
@@ -177,7 +257,7 @@ class Matrix
 	void subtract(double vector[], int m, int axis);
 
 	/** Print the matrix to stdout */
-	void print();
+	void print() const;
 	
 	/** clear all entries in the matrix. leaves an empty 0 x 0 matrix. */
 	void clear();
@@ -186,20 +266,160 @@ class Matrix
 	~Matrix();
 
 	private:
-	std::vector< std::vector<double> > columns; ///columns of matrix--this is kept up to date as matrix is modified
-	
-	/// representation of matrix as 1-d array in column major order.  This is not kept up to date as
-	/// matrix is created/modified, but only updated when needed for an operation
-	double * entries ; 
-
-	void updateArray(); ///< update column-major representation in entries
+	/// matrix entries as one contiguous, 64-byte aligned array in column-major order
+	/// (entry (i,j) lives at entries[j*numRows + i]); this is the only copy of the data,
+	/// and is handed to lapack directly.
+	double * entries;
 
-	bool changed;//< has matrix been modified since last call to updateArray()?
 	int numRows; ///< number of rows in matrix
 	int numCols; ///< number of columns in matrix
 
-	/// matrix mult A*B, where A and B are matrices represented in column-major form, with dimensions
-	/// rows1xcols1 and cols1xcols2 respectively.
-	void dot(double A[], double B[], int rows1, int cols1, int cols2, double result[]);
+	/// allocate an aligned, zero-filled array of the given number of doubles (0 for an empty array)
+	static double * allocEntries(std::size_t count);
+
+	/// release an array obtained from allocEntries()
+	static void freeEntries(double * array);
+};
+
+/* element access is on the innermost loop of the EM code, so keep it inline */
+
+inline double Matrix::getValue(int i, int j) const
+{
+	return entries[(std::size_t)j*numRows + i];
+}
+
+inline double * Matrix::getArray()
+{
+	return entries;
+}
+
+inline const double * Matrix::getArray() const
+{
+	return entries;
+}
+
+inline void Matrix::update(double val, int i, int j)
+{
+	if (j>=numCols || j<0) throw SizeError("Error: attempt to write value to a non-existent column");
+	if (i>=numRows || i<0) throw SizeError("Error: attempt to write value to a non-existent row");
+	entries[(std::size_t)j*numRows + i] = val;
+}
+
+
+/*! \brief Cholesky factorization A = L*L' of a symmetric positive definite matrix
+*
+* Holds the lower triangular factor L together with log(det(A)), so the factorization
+* can be computed once (e.g. once per covariance per EM iteration) and reused for any
+* number of solves and Mahalanobis distances.
+*/
+class Cholesky
+{
+	public:
+	/** create an empty (0 x 0) factorization */
+	Cholesky();
+
+	/** factor A = L*L' (only the lower triangle of A is read)
+	@param A symmetric positive definite matrix
+	@throw SizeError if A is not square
+	@throw LapackError if A is not positive definite*/
+	explicit Cholesky(const Matrix & A) throw (SizeError, LapackError);
+
+	/**@return the dimension of the factored matrix*/
+	int dimension() const;
+
+	/**@return log(det(A)), computed from the diagonal of L (no overflow for large dimensions)*/
+	double logdet() const;
+
+	/**@return the lower triangular factor L (upper triangle is 0)*/
+	const Matrix & factor() const;
+
+	/**@return the whitening matrix inv(L), lower triangular: x' * inv(A) * x = |inv(L)*x|^2.
+	Computing it once lets many mahalanobis distances be taken with matrix-vector products.*/
+	Matrix whitener() const throw (LapackError);
+
+	/** solve A*x = b in place
+	@param b on input the right hand side, on output the solution (length dimension())*/
+	void solve(double b[]) const;
+
+	/** Mahalanobis distance x' * inv(A) * x
+	@param x vector of length dimension()
+	@return the squared distance*/
+	double mahalanobis(const double x[]) const;
+
+	/** Mahalanobis distance (x-mu)' * inv(A) * (x-mu)
+	@param x vector of length dimension()
+	@param mu vector of length dimension()
+	@return the squared distance*/
+	double mahalanobis(const double x[], const double mu[]) const;
+
+	private:
+	Matrix L; ///< lower triangular factor
+	double logDeterminant; ///< log(det(A)) = 2*sum(log(L(i,i)))
 };
+
+
+/*! \brief Cholesky factorizations of a batch of k same-sized covariance matrices, laid out for scoring
+*
+* The k matrices are factored in parallel (one per thread where OpenMP is available). What the
+* density kernels need is kept in contiguous, aligned arrays: the k whitening matrices inv(L), each
+* dim x dim column-major with leading dimension paddedLeadingDimension(dim), back to back, and the
+* k gaussian log normalizers -0.5*(dim*log(2*pi) + log(det(A))).
+*/
+class CholeskyBatch
+{
+	public:
+	/** factor every matrix of a batch
+	@param A the k symmetric positive definite dim x dim matrices (only lower triangles are read)
+	@throw SizeError if the matrices are not all square and the same size
+	@throw LapackError if any matrix is not positive definite*/
+	explicit CholeskyBatch(const std::vector<Matrix *> & A) throw (SizeError, LapackError);
+
+	/**@return the number of factored matrices (k)*/
+	int size() const { return (int)logDeterminants.size(); }
+
+	/**@return the dimension of each factored matrix*/
+	int dimension() const { return dim; }
+
+	/**@return the leading dimension of each whitening matrix (dim padded to a whole number of SIMD registers)*/
+	int leadingDimension() const { return lead; }
+
+	/**@return the k whitening matrices inv(L), each dim x dim lower triangular column-major, contiguous*/
+	const double * whiteners() const { return whitenerArray.empty() ? 0 : &whitenerArray[0]; }
+
+	/** @param g 0-rel index of a matrix in the batch
+	@return inv(L) for matrix g (dim x dim lower triangular, column-major, leading dimension leadingDimension())*/
+	const double * whitener(int g) const { return whiteners() + (std::size_t)g*lead*dim; }
+
+	/**@return the k log determinants, contiguous*/
+	const double * logdets() const { return logDeterminants.empty() ? 0 : &logDeterminants[0]; }
+
+	/**@return the k gaussian log normalizers -0.5*(dim*log(2*pi) + log(det(A))), contiguous*/
+	const double * logNormalizers() const { return logNorms.empty() ? 0 : &logNorms[0]; }
+
+	/** squared Mahalanobis distance of (x-mu) under matrix g, |inv(L)*(x-mu)|^2
+	@param g 0-rel index of a matrix in the batch
+	@param x vector of length dimension()
+	@param mu vector of length dimension()
+	@return the squared distance*/
+	double mahalanobis(int g, const double x[], const double mu[]) const;
+
+	/** squared Mahalanobis distances of a block of points under matrix g, d[i] = |inv(L)*(x_i-mu)|^2.
+	The centered block is whitened with one triangular matrix multiply (BLAS-3), then its row norms are taken.
+	@param g 0-rel index of a matrix in the batch
+	@param count number of points in the block
+	@param X the points, a count x dimension() column-major block (one point per row) with leading dimension ldx
+	@param ldx leading dimension of X (>= count)
+	@param mu vector of length dimension()
+	@param work scratch space for count*dimension() doubles
+	@param[out] d the count squared distances*/
+	void mahalanobisBlock(int g, int count, const double X[], int ldx, const double mu[], double work[], double d[]) const;
+
+	private:
+	int dim;
+	int lead;
+	AlignedVector<double> whitenerArray;
+	std::vector<double> logDeterminants;
+	std::vector<double> logNorms;
+};
+
 #endif //MATRIX_HEADER
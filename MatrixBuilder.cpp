@@ -0,0 +1,138 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file MatrixBuilder.cpp
+*   \brief MatrixBuilder class method implementations.
+*/
+
+#include "MatrixBuilder.h"
+
+
+/**
+\brief create an empty builder
+@param cols number of columns of every row
+@param pad lay rows out with a SIMD-padded leading dimension
+*/
+MatrixBuilder::MatrixBuilder(int cols, bool pad)
+    : numCols(cols), numRows(0), lead(pad ? paddedLeadingDimension(cols) : cols)
+{
+}
+
+/**
+\brief make room for rows without reallocating
+@param rows expected total number of rows
+*/
+void MatrixBuilder::reserve(int rows)
+{
+    values.reserve((std::size_t)rows*lead);
+}
+
+/**
+\brief append a row
+@param row array of colCount() values
+*/
+void MatrixBuilder::appendRow(const double row[])
+{
+    values.insert(values.end(), row, row + numCols);
+    values.resize((std::size_t)(numRows+1)*lead, 0.0);
+    numRows++;
+}
+
+/**
+\brief append a row of another matrix
+@param X view of a matrix with colCount() columns
+@param row 0-rel row of X
+*/
+void MatrixBuilder::appendRow(const MatrixView & X, int row) throw (SizeError)
+{
+    if (X.colCount()!=numCols)
+        throw SizeError((char*)"Error: tried to append a row of the wrong length");
+
+    double scratch[numCols];
+    appendRow(X.row(row, scratch));
+}
+
+/**
+\brief view the rows appended so far
+@return a row-major view, valid until the next append
+*/
+MatrixView MatrixBuilder::view() const
+{
+    return MatrixView(values.empty() ? 0 : &values[0], numRows, numCols, lead, Matrix::ROW_MAJOR);
+}
+
+/**
+\brief copy the rows appended so far into a Matrix
+@return the matrix
+*/
+Matrix MatrixBuilder::build() const
+{
+    Matrix M(numRows, numCols);
+    double * a = M.getArray();
+    for (int i=0; i<numRows; i++)
+        for (int j=0; j<numCols; j++)
+            a[(std::size_t)j*numRows + i] = values[(std::size_t)i*lead + j];
+    return M;
+}
+
+/**
+\brief gather labelled rows into a new matrix: one pass over the labels to size it, one over the data to fill it
+@param X view of the data
+@param labels one label per row of X
+@param label the label to select
+@return the selected rows
+*/
+Matrix gatherRows(const MatrixView & X, const std::vector<int> & labels, int label) throw (SizeError)
+{
+    int n = X.rowCount();
+    int m = X.colCount();
+    if ((int)labels.size() < n)
+        throw SizeError((char*)"Error: fewer labels than rows to gather from");
+
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        if (labels[i] == label)
+            count++;
+
+    Matrix S(count, m);
+    double * s = S.getArray();
+    double scratch[m];
+    int r = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (labels[i] != label)
+            continue;
+        const double * x = X.row(i, scratch);
+        for (int j = 0; j < m; j++)
+            s[(std::size_t)j*count + r] = x[j];
+        r++;
+    }
+    return S;
+}
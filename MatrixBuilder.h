@@ -0,0 +1,106 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+
+/*! \file MatrixBuilder.h
+*   \brief Definitions for building a Matrix one row at a time, and for gathering labelled rows
+*/
+#ifndef MATRIX_BUILDER_H
+#define MATRIX_BUILDER_H
+
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "AlignedAllocator.h"
+
+
+/*! \brief growable row-major buffer that rows are appended to, then turned into a Matrix
+*
+* Appending a row costs amortized O(cols), unlike Matrix::insertRow, which re-lays out the whole
+* matrix. Use reserve() when the final row count (or a bound on it) is known up front.
+* The buffer is GAUSSMIX_ALIGNMENT-aligned; with padding on, rows are laid out with a leading
+* dimension of paddedLeadingDimension(cols) (zero-filled), so every row of view() starts aligned.
+*/
+class MatrixBuilder
+{
+	public:
+	/** create an empty builder for rows of a given length
+	@param cols number of columns of every row
+	@param pad lay rows out with a SIMD-padded leading dimension*/
+	explicit MatrixBuilder(int cols, bool pad=false);
+
+	/** make room for a number of rows without further reallocation
+	@param rows expected total number of rows*/
+	void reserve(int rows);
+
+	/** append a row
+	@param row array of colCount() values*/
+	void appendRow(const double row[]);
+
+	/** append a row of another matrix
+	@param X view of a matrix with colCount() columns
+	@param row 0-rel row of X to append*/
+	void appendRow(const MatrixView & X, int row) throw (SizeError);
+
+	/**@return the number of rows appended so far*/
+	int rowCount() const { return numRows; }
+
+	/**@return the number of columns*/
+	int colCount() const { return numCols; }
+
+	/**@return the distance between consecutive rows of view()*/
+	int leadingDimension() const { return lead; }
+
+	/**@return a row-major view of the rows appended so far (valid until the next append)*/
+	MatrixView view() const;
+
+	/**@return a Matrix holding the rows appended so far*/
+	Matrix build() const;
+
+	private:
+	int numCols;
+	int numRows;
+	int lead;
+	AlignedVector<double> values; ///< row-major, leading dimension lead
+};
+
+
+/*! \brief gather the rows of X whose label matches, in order, into a new matrix
+*
+@param X view of the data (one sample per row)
+@param labels one label per row of X
+@param label the label to select
+@return a Matrix holding the selected rows (0 rows if none match)
+@throw SizeError if there are fewer labels than rows
+*/
+Matrix gatherRows(const MatrixView & X, const std::vector<int> & labels, int label) throw (SizeError);
+
+#endif /* MATRIX_BUILDER_H */
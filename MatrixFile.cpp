@@ -0,0 +1,231 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file MatrixFile.cpp
+*   \brief matrix file reading, writing and mapping
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AlignedAllocator.h"
+#include "MatrixFile.h"
+
+
+static const char MATRIX_FILE_MAGIC[8] = {'G','M','X','M','A','T','R','X'};
+static const uint32_t MATRIX_FILE_BYTE_ORDER = 0x01020304;
+
+
+/**
+\brief write a view of doubles or floats to a matrix file
+@param path file to create
+@param X the data
+@param layout orientation to store it in
+@param dtype MatrixFileType matching T
+*/
+template<typename T>
+static void writeMatrix(const char * path, const BasicMatrixView<T> & X, Matrix::Orientation layout,
+        MatrixFileType dtype) throw (FileError)
+{
+    const int perBlock = GAUSSMIX_ALIGNMENT / sizeof(T);
+    int lines = (layout==Matrix::ROW_MAJOR) ? X.rowCount() : X.colCount();
+    int inner = (layout==Matrix::ROW_MAJOR) ? X.colCount() : X.rowCount();
+    int lead = (inner + perBlock - 1) / perBlock * perBlock;
+
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = MATRIX_FILE_VERSION;
+    header.byteOrder = MATRIX_FILE_BYTE_ORDER;
+    header.dtype = dtype;
+    header.layout = layout;
+    header.rows = X.rowCount();
+    header.cols = X.colCount();
+    header.lead = lead;
+    header.dataOffset = (sizeof(header) + GAUSSMIX_ALIGNMENT - 1) / GAUSSMIX_ALIGNMENT * GAUSSMIX_ALIGNMENT;
+    header.alignment = GAUSSMIX_ALIGNMENT;
+
+    FILE * out = fopen(path, "wb");
+    if (!out)
+        throw FileError("Error: could not create matrix file");
+
+    bool ok = (fwrite(&header, sizeof(header), 1, out) == 1);
+    std::vector<char> gap(header.dataOffset - sizeof(header), 0);
+    if (ok && !gap.empty())
+        ok = (fwrite(&gap[0], 1, gap.size(), out) == gap.size());
+
+    // one row (or column) at a time, padding included
+    std::vector<T> line(lead, T(0));
+    for (int l = 0; ok && l < lines; l++)
+    {
+        for (int e = 0; e < inner; e++)
+            line[e] = (layout==Matrix::ROW_MAJOR) ? (T)X.getValue(l,e) : (T)X.getValue(e,l);
+        ok = (fwrite(&line[0], sizeof(T), lead, out) == (std::size_t)lead);
+    }
+
+    if (fclose(out) != 0 || !ok)
+        throw FileError("Error: could not write matrix file");
+}
+
+/**
+\brief write a matrix of doubles to a file
+@param path file to create (or overwrite)
+@param X the data to write
+@param layout orientation to store the data in
+*/
+void saveMatrix(const char * path, const MatrixView & X, Matrix::Orientation layout) throw (FileError)
+{
+    writeMatrix(path, X, layout, MATRIX_FILE_DOUBLE);
+}
+
+/**
+\brief write a matrix of floats to a file
+@param path file to create (or overwrite)
+@param X the data to write
+@param layout orientation to store the data in
+*/
+void saveMatrix(const char * path, const FloatMatrixView & X, Matrix::Orientation layout) throw (FileError)
+{
+    writeMatrix(path, X, layout, MATRIX_FILE_FLOAT);
+}
+
+/**
+\brief read a matrix file into a new Matrix
+@param path file to read
+@return the matrix, widened to double
+*/
+Matrix loadMatrix(const char * path) throw (FileError)
+{
+    MappedMatrix mapped(path);
+    Matrix M(mapped.rowCount(), mapped.colCount());
+    if (mapped.type()==MATRIX_FILE_DOUBLE)
+    {
+        MatrixView X = mapped.view();
+        for (int j = 0; j < X.colCount(); j++)
+            for (int i = 0; i < X.rowCount(); i++)
+                M.update(X.getValue(i,j), i, j);
+    }
+    else
+    {
+        FloatMatrixView X = mapped.floatView();
+        for (int j = 0; j < X.colCount(); j++)
+            for (int i = 0; i < X.rowCount(); i++)
+                M.update(X.getValue(i,j), i, j);
+    }
+    return M;
+}
+
+
+/**
+\brief map a matrix file and check its header
+@param path file to map
+*/
+MappedMatrix::MappedMatrix(const char * path) throw (FileError)
+    : base(MAP_FAILED), length(0), header(0)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw FileError("Error: could not open matrix file");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (std::size_t)info.st_size < sizeof(MatrixFileHeader))
+    {
+        close(fd);
+        throw FileError("Error: matrix file is truncated");
+    }
+    length = info.st_size;
+    base = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        throw FileError("Error: could not map matrix file");
+    header = static_cast<const MatrixFileHeader *>(base);
+
+    // everything the views rely on must hold, or the mapping is useless
+    const char * problem = 0;
+    std::size_t elementSize = (header->dtype==MATRIX_FILE_FLOAT) ? sizeof(float) : sizeof(double);
+    int64_t inner = (header->layout==Matrix::ROW_MAJOR) ? header->cols : header->rows;
+    int64_t lines = (header->layout==Matrix::ROW_MAJOR) ? header->rows : header->cols;
+    if (memcmp(header->magic, MATRIX_FILE_MAGIC, sizeof(header->magic)) != 0)
+        problem = "Error: not a matrix file";
+    else if (header->byteOrder != MATRIX_FILE_BYTE_ORDER)
+        problem = "Error: matrix file was written with a different byte order";
+    else if (header->version != MATRIX_FILE_VERSION)
+        problem = "Error: unsupported matrix file version";
+    else if (header->dtype != MATRIX_FILE_DOUBLE && header->dtype != MATRIX_FILE_FLOAT)
+        problem = "Error: unknown matrix file element type";
+    else if (header->layout != Matrix::ROW_MAJOR && header->layout != Matrix::COLUMN_MAJOR)
+        problem = "Error: unknown matrix file layout";
+    else if (header->rows < 0 || header->cols < 0 || header->rows > INT32_MAX || header->cols > INT32_MAX ||
+            header->lead < inner || header->lead > INT32_MAX)
+        problem = "Error: bad matrix file dimensions";
+    else if (header->dataOffset < sizeof(MatrixFileHeader) || header->dataOffset % elementSize != 0 ||
+            header->dataOffset > length || (uint64_t)(lines * header->lead) > (length - header->dataOffset) / elementSize)
+        problem = "Error: matrix file is truncated";
+    if (problem)
+    {
+        munmap(base, length);
+        throw FileError(problem);
+    }
+}
+
+MappedMatrix::~MappedMatrix()
+{
+    munmap(base, length);
+}
+
+/**
+\brief view the data of a double matrix file in place
+@return view into the mapping
+*/
+MatrixView MappedMatrix::view() const throw (FileError)
+{
+    if (header->dtype != MATRIX_FILE_DOUBLE)
+        throw FileError("Error: matrix file does not hold doubles");
+    const double * data = reinterpret_cast<const double *>(static_cast<const char *>(base) + header->dataOffset);
+    return MatrixView(data, rowCount(), colCount(), (int)header->lead, orientation());
+}
+
+/**
+\brief view the data of a float matrix file in place
+@return view into the mapping
+*/
+FloatMatrixView MappedMatrix::floatView() const throw (FileError)
+{
+    if (header->dtype != MATRIX_FILE_FLOAT)
+        throw FileError("Error: matrix file does not hold floats");
+    const float * data = reinterpret_cast<const float *>(static_cast<const char *>(base) + header->dataOffset);
+    return FloatMatrixView(data, rowCount(), colCount(), (int)header->lead, orientation());
+}
@@ -0,0 +1,147 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file MatrixFile.h
+*   \brief Definitions for a versioned binary Matrix file format that is read back with mmap
+*/
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdint.h>
+#include <stdexcept>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+
+
+//! current version of the matrix file format
+const uint32_t MATRIX_FILE_VERSION = 1;
+
+//! scalar type of the elements of a matrix file
+enum MatrixFileType { MATRIX_FILE_DOUBLE = 0, MATRIX_FILE_FLOAT = 1 };
+
+//! class for returning errors due to unreadable, unwritable or malformed matrix files */
+class FileError: public std::runtime_error
+{
+	public:
+	FileError(const char* error="Matrix file could not be read or written."):std::runtime_error(error){}
+};
+
+/*! \brief fixed 64 byte header at the start of every matrix file
+*
+* Layout on disk: the header, then (at offset dataOffset, a multiple of alignment) the elements,
+* stored with leading dimension lead. For ROW_MAJOR element (i,j) is at data[i*lead + j], for
+* COLUMN_MAJOR at data[j*lead + i], exactly as in a MatrixView. Rows (or columns) are zero-padded
+* to a whole number of alignment-sized blocks so each one starts aligned (for doubles, lead is
+* paddedLeadingDimension()). Everything is in native byte order;
+* byteOrder lets a reader on the other endianness notice.
+*/
+struct MatrixFileHeader
+{
+	char magic[8]; ///< "GMXMATRX"
+	uint32_t version; ///< MATRIX_FILE_VERSION
+	uint32_t byteOrder; ///< 0x01020304, as written by the host
+	uint32_t dtype; ///< a MatrixFileType
+	uint32_t layout; ///< a Matrix::Orientation
+	int64_t rows; ///< number of rows
+	int64_t cols; ///< number of columns
+	int64_t lead; ///< leading dimension, in elements
+	uint64_t dataOffset; ///< byte offset of element (0,0) from the start of the file
+	uint32_t alignment; ///< alignment of the data, in bytes
+	uint32_t reserved[3]; ///< zero
+};
+
+/** write a matrix of doubles to a file (a Matrix converts implicitly)
+@param path file to create (or overwrite)
+@param X the data to write
+@param layout orientation to store the data in
+@throw FileError if the file cannot be written*/
+void saveMatrix(const char * path, const MatrixView & X, Matrix::Orientation layout=Matrix::ROW_MAJOR) throw (FileError);
+
+/** write a matrix of floats to a file
+@param path file to create (or overwrite)
+@param X the data to write
+@param layout orientation to store the data in
+@throw FileError if the file cannot be written*/
+void saveMatrix(const char * path, const FloatMatrixView & X, Matrix::Orientation layout=Matrix::ROW_MAJOR) throw (FileError);
+
+/** read a matrix file (of either type) into a new Matrix, e.g. for model parameters
+@param path file to read
+@return the matrix, widened to double
+@throw FileError if the file cannot be read or is not a valid matrix file*/
+Matrix loadMatrix(const char * path) throw (FileError);
+
+
+/*! \brief read-only memory mapping of a matrix file
+*
+* The file is mapped, its header checked, and the data used where it lies: no parsing, no copy.
+* Views handed out point into the mapping, so they are only valid while the MappedMatrix lives.
+* Pages are loaded lazily by the OS and shared between processes mapping the same file.
+*/
+class MappedMatrix
+{
+	public:
+	/** map a matrix file
+	@param path file to map
+	@throw FileError if the file cannot be mapped or is not a valid matrix file*/
+	explicit MappedMatrix(const char * path) throw (FileError);
+
+	~MappedMatrix();
+
+	/**@return the number of rows*/
+	int rowCount() const { return (int)header->rows; }
+
+	/**@return the number of columns*/
+	int colCount() const { return (int)header->cols; }
+
+	/**@return the element type of the file*/
+	MatrixFileType type() const { return (MatrixFileType)header->dtype; }
+
+	/**@return the storage orientation of the file*/
+	Matrix::Orientation orientation() const { return (Matrix::Orientation)header->layout; }
+
+	/** view the data of a MATRIX_FILE_DOUBLE file in place
+	@throw FileError if the file holds floats*/
+	MatrixView view() const throw (FileError);
+
+	/** view the data of a MATRIX_FILE_FLOAT file in place
+	@throw FileError if the file holds doubles*/
+	FloatMatrixView floatView() const throw (FileError);
+
+	private:
+	MappedMatrix(const MappedMatrix &);
+	MappedMatrix & operator=(const MappedMatrix &);
+
+	void * base; ///< start of the mapping
+	std::size_t length; ///< length of the mapping, in bytes
+	const MatrixFileHeader * header; ///< the header, at the start of the mapping
+};
+
+#endif //MATRIX_FILE_H
@@ -0,0 +1,178 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file MatrixView.h
+*   \brief Definitions for a non-owning, strided view of a dense matrix held in caller-owned memory
+*/
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+#include <cstddef>
+#include <type_traits>
+
+#include "Matrix.h"
+
+
+/*! \brief read-only view of a dense rows x cols matrix of T (double or float) that lives in memory owned by someone else
+*
+* The view is just a pointer, a shape, a leading dimension and an orientation, so it can describe
+* a Matrix, a plain array, a block of a larger array or a mmapped file without copying anything.
+* Element (i,j) is at data[i*ld + j] for ROW_MAJOR and data[j*ld + i] for COLUMN_MAJOR.
+* The caller must keep the memory alive (and unchanged) for as long as the view is used.
+*
+* Whatever T is, values are read out as doubles: the EM code keeps its sums, means and covariances
+* in double, so float data costs half the memory and bandwidth without losing accumulator precision.
+*/
+template<typename T>
+class BasicMatrixView
+{
+	public:
+	/** create a view over a caller-owned array
+	@param data pointer to element (0,0)
+	@param rows number of rows
+	@param cols number of columns
+	@param ld leading dimension (distance between consecutive rows for ROW_MAJOR, columns for COLUMN_MAJOR)
+	@param orient Matrix::ROW_MAJOR or Matrix::COLUMN_MAJOR*/
+	BasicMatrixView(const T * data, int rows, int cols, int ld, Matrix::Orientation orient=Matrix::ROW_MAJOR)
+		: values(data), numRows(rows), numCols(cols), lead(ld), layout(orient)
+	{
+		if (rows < 0 || cols < 0 || ld < (orient==Matrix::ROW_MAJOR ? cols : rows))
+			throw SizeError("Error: matrix view leading dimension is smaller than its row or column length");
+	}
+
+	/** create a (column-major) view of a Matrix (double views only). Only valid until M is resized or destroyed.
+	@param M matrix to view*/
+	template<typename U = T, typename = typename std::enable_if<std::is_same<U, double>::value>::type>
+	BasicMatrixView(const Matrix & M)
+		: values(M.getArray()), numRows(M.rowCount()), numCols(M.colCount()),
+		  lead(M.rowCount()), layout(Matrix::COLUMN_MAJOR) {}
+
+	/**@return the number of rows*/
+	int rowCount() const { return numRows; }
+
+	/**@return the number of columns*/
+	int colCount() const { return numCols; }
+
+	/**@return the leading dimension*/
+	int leadingDimension() const { return lead; }
+
+	/**@return the storage orientation*/
+	Matrix::Orientation orientation() const { return layout; }
+
+	/**@return pointer to element (0,0)*/
+	const T * data() const { return values; }
+
+	/**@return the element in ith row, jth column (indexed from 0)*/
+	double getValue(int i, int j) const
+	{
+		return (layout==Matrix::ROW_MAJOR) ? values[(std::size_t)i*lead + j] : values[(std::size_t)j*lead + i];
+	}
+
+	/** get the ith row as a contiguous array of doubles. For row-major double views this is a pointer
+	straight into the viewed memory; otherwise the row is gathered (and widened) into scratch.
+	@param i 0-rel row number
+	@param scratch caller-provided space for colCount() doubles
+	@return pointer to colCount() contiguous doubles holding row i*/
+	const double * row(int i, double * scratch) const
+	{
+		if (layout==Matrix::ROW_MAJOR)
+		{
+			const T * r = values + (std::size_t)i*lead;
+			const double * direct = inPlace(r);
+			if (direct)
+				return direct;
+			for (int j=0; j<numCols; j++)
+				scratch[j] = r[j];
+			return scratch;
+		}
+		for (int j=0; j<numCols; j++)
+			scratch[j] = values[(std::size_t)j*lead + i];
+		return scratch;
+	}
+
+	/** copy (and widen) a contiguous range of rows into a column-major block of doubles, the
+	layout the blocked (BLAS-3) kernels work on
+	@param first 0-rel number of the first row
+	@param count number of rows
+	@param block caller-provided space for count x colCount() doubles
+	@param ld leading dimension of block (>= count)*/
+	void copyRowBlock(int first, int count, double * block, int ld) const
+	{
+		if (first < 0 || count < 0 || first+count > numRows || ld < count)
+			throw SizeError("Error: attempted to copy non-existent rows");
+		for (int j=0; j<numCols; j++)
+		{
+			double * column = block + (std::size_t)j*ld;
+			if (layout==Matrix::COLUMN_MAJOR)
+			{
+				const T * source = values + (std::size_t)j*lead + first;
+				for (int i=0; i<count; i++)
+					column[i] = source[i];
+			}
+			else
+			{
+				const T * source = values + (std::size_t)first*lead + j;
+				for (int i=0; i<count; i++)
+					column[i] = source[(std::size_t)i*lead];
+			}
+		}
+	}
+
+	/** view a contiguous range of rows of this view
+	@param first 0-rel number of the first row
+	@param count number of rows
+	@return a view of rows first .. first+count-1*/
+	BasicMatrixView rowBlock(int first, int count) const
+	{
+		if (first < 0 || count < 0 || first+count > numRows)
+			throw SizeError("Error: attempted to view non-existent rows");
+		const T * start = (layout==Matrix::ROW_MAJOR) ? values + (std::size_t)first*lead : values + first;
+		return BasicMatrixView(start, count, numCols, lead, layout);
+	}
+
+	private:
+	/// a row of doubles can be read where it lies; any other type must be widened first
+	static const double * inPlace(const double * r) { return r; }
+	static const double * inPlace(const float *) { return 0; }
+
+	const T * values; ///< element (0,0); not owned
+	int numRows; ///< number of rows
+	int numCols; ///< number of columns
+	int lead; ///< leading dimension
+	Matrix::Orientation layout; ///< storage orientation
+};
+
+/*! \brief view of double data (a Matrix converts to one implicitly) */
+typedef BasicMatrixView<double> MatrixView;
+
+/*! \brief view of float data, e.g. float32 features straight from their source */
+typedef BasicMatrixView<float> FloatMatrixView;
+
+#endif //MATRIX_VIEW_H
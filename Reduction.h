@@ -0,0 +1,101 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file Reduction.h
+*   \brief per-thread accumulators and their reproducible (pairwise) reduction
+*/
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include <vector>
+#include <cstddef>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+
+/*! \brief number of per-thread accumulators a parallel region needs (one per thread it may run on)
+*/
+inline int accumulatorCount()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif /* _OPENMP */
+}
+
+/*! \brief index of the calling thread's accumulator, inside a parallel region
+*/
+inline int accumulatorIndex()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif /* _OPENMP */
+}
+
+/*! \brief add one flat accumulator into another of the same size
+@param[in,out] total accumulator added to
+@param[in] part accumulator to add
+*/
+inline void reduceInto(std::vector<double> & total, const std::vector<double> & part)
+{
+	double * t = total.empty() ? 0 : &total[0];
+	const double * p = part.empty() ? 0 : &part[0];
+	std::size_t size = total.size();
+	for (std::size_t i=0; i<size; i++)
+		t[i] += p[i];
+}
+
+/*! \brief combine per-thread accumulators pairwise, as a binary tree: partials[0] ends up with the total
+*
+* log2(count) levels, each adding disjoint pairs in parallel. Which partials are added to which depends
+* only on how many there are, so for a fixed number of threads the total is bitwise reproducible.
+* Accumulator is anything with a reduceInto(Accumulator &, const Accumulator &) overload.
+@param[in,out] partials the accumulators (all but partials[0] are left partly summed)
+*/
+template<typename Accumulator>
+void treeReduce(std::vector<Accumulator> & partials)
+{
+	int count = (int)partials.size();
+	for (int stride=1; stride<count; stride*=2)
+	{
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(static)
+#endif /* _OPENMP */
+		for (int i=0; i<count-stride; i+=2*stride)
+			reduceInto(partials[i], partials[i+stride]);
+	}
+}
+
+#endif /* REDUCTION_H */
@@ -0,0 +1,264 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+
+/*! \file SmallMatrix.h
+*   \brief Fixed-dimension matrix and Cholesky kernels for small (m <= 16) covariance matrices
+*/
+#ifndef SMALL_MATRIX_H
+#define SMALL_MATRIX_H
+
+#include <cmath>
+#include <utility>
+
+#include "Matrix.h"
+#include "AlignedAllocator.h"
+
+
+/*! \brief largest dimension for which fixed-size kernels are instantiated */
+const int SMALL_MATRIX_MAX_DIM = 16;
+
+
+/*! \brief dense M x M matrix whose size is known at compile time
+*
+* Entries live inline, column-major, so a SmallMatrix needs no heap allocation and every loop
+* over it has a constant trip count the compiler can fully unroll and vectorize. Only the
+* operations the EM inner loops need are provided; convert to and from Matrix at the edges.
+*/
+template<int M>
+class SmallMatrix
+{
+	public:
+	/** create an M x M matrix of zeros*/
+	SmallMatrix()
+	{
+		for (int i=0; i<M*M; i++)
+			entries[i] = 0.0;
+	}
+
+	/** copy an M x M Matrix
+	@param A matrix to copy*/
+	explicit SmallMatrix(const Matrix & A) throw (SizeError)
+	{
+		if (A.rowCount()!=M || A.colCount()!=M)
+			throw SizeError("Error: matrix does not have the fixed dimension of the small matrix kernel");
+		const double * a = A.getArray();
+		for (int i=0; i<M*M; i++)
+			entries[i] = a[i];
+	}
+
+	/** copy this matrix into an M x M Matrix
+	@param[out] A matrix to overwrite*/
+	void copyTo(Matrix & A) const throw (SizeError)
+	{
+		if (A.rowCount()!=M || A.colCount()!=M)
+			throw SizeError("Error: matrix does not have the fixed dimension of the small matrix kernel");
+		double * a = A.getArray();
+		for (int i=0; i<M*M; i++)
+			a[i] = entries[i];
+	}
+
+	/** get value (unchecked)
+	@param i 0-rel row
+	@param j 0-rel column
+	@return value at (i,j)*/
+	double getValue(int i, int j) const { return entries[j*M + i]; }
+
+	/**@return the column-major entries*/
+	double * getArray() { return entries; }
+
+	/**@return the column-major entries (read-only)*/
+	const double * getArray() const { return entries; }
+
+	/** symmetric rank-1 update of the lower triangle: this += alpha*x*x'
+	@param alpha scalar multiplier
+	@param x vector of length M*/
+	void syr(double alpha, const double x[M])
+	{
+		for (int j=0; j<M; j++)
+		{
+			double temp = alpha*x[j];
+			for (int i=j; i<M; i++)
+				entries[j*M + i] += x[i]*temp;
+		}
+	}
+
+	/** copy the lower triangle onto the upper triangle*/
+	void symmetrize()
+	{
+		for (int j=1; j<M; j++)
+			for (int i=0; i<j; i++)
+				entries[j*M + i] = entries[i*M + j];
+	}
+
+	/** divide every entry by a scalar
+	@param d divisor*/
+	void divide(double d)
+	{
+		for (int i=0; i<M*M; i++)
+			entries[i] /= d;
+	}
+
+	private:
+	double entries[M*M];
+};
+
+
+/*! \brief Cholesky factorization A = L*L' of a symmetric positive definite SmallMatrix
+*
+* Fixed-size counterpart of Cholesky: same log determinant and mahalanobis distance, computed
+* with unrolled loops instead of LAPACK/BLAS calls.
+*/
+template<int M>
+class SmallCholesky
+{
+	public:
+	/** factor a symmetric positive definite matrix (only the lower triangle is read)
+	@param A matrix to factor
+	@throw LapackError if A is not positive definite*/
+	explicit SmallCholesky(const SmallMatrix<M> & A) throw (LapackError)
+	{
+		logDeterminant = 0.0;
+		for (int j=0; j<M; j++)
+		{
+			double d = A.getValue(j,j);
+			for (int p=0; p<j; p++)
+				d -= L[p*M + j]*L[p*M + j];
+			if (!(d > 0.0))
+				throw LapackError("Error: matrix is not positive definite in SmallCholesky");
+			double ljj = sqrt(d);
+			L[j*M + j] = ljj;
+			logDeterminant += 2.0*log(ljj);
+
+			for (int i=j+1; i<M; i++)
+			{
+				double s = A.getValue(i,j);
+				for (int p=0; p<j; p++)
+					s -= L[p*M + i]*L[p*M + j];
+				L[j*M + i] = s/ljj;
+			}
+		}
+	}
+
+	/**@return log(det(A))*/
+	double logdet() const { return logDeterminant; }
+
+	/** squared mahalanobis distance (x-mu)' * inv(A) * (x-mu)
+	@param x vector of length M
+	@param mu vector of length M
+	@return the distance*/
+	double mahalanobis(const double x[M], const double mu[M]) const
+	{
+		// forward substitution: z = inv(L) * (x-mu)
+		double z[M];
+		double sum = 0.0;
+		for (int i=0; i<M; i++)
+		{
+			double s = x[i] - mu[i];
+			for (int p=0; p<i; p++)
+				s -= L[p*M + i]*z[p];
+			z[i] = s/L[i*M + i];
+			sum += z[i]*z[i];
+		}
+		return sum;
+	}
+
+	private:
+	// column-major lower triangle of the factor; the upper triangle is never read
+	double L[M*M];
+	double logDeterminant;
+};
+
+
+/*! \brief squared norm of a whitened difference, |W*(x-mu)|^2
+*
+* W is a lower triangular M x M column-major whitening matrix inv(L), as produced by
+* Cholesky::whitener() or CholeskyBatch, so the result is the mahalanobis distance of x from mu.
+* LD is the leading dimension of W; the default matches CholeskyBatch's padded layout.
+@param W whitening matrix
+@param x vector of length M
+@param mu vector of length M
+@return the squared distance
+*/
+template<int M, int LD = paddedLeadingDimension(M)>
+inline double whitenedSquaredNorm(const double * W, const double x[M], const double mu[M])
+{
+	double difference[M];
+	double z[M];
+	for (int i=0; i<M; i++)
+	{
+		difference[i] = x[i] - mu[i];
+		z[i] = 0.0;
+	}
+	for (int j=0; j<M; j++)
+		for (int i=j; i<M; i++)
+			z[i] += W[j*LD + i]*difference[j];
+
+	double sum = 0.0;
+	for (int i=0; i<M; i++)
+		sum += z[i]*z[i];
+	return sum;
+}
+
+
+/*! \brief run Kernel<m>::run(args...) if m has a fixed-size instantiation
+*
+* Kernel is a class template over the dimension with a static run() method; this turns the
+* runtime dimension into a compile-time one for 2 <= m <= SMALL_MATRIX_MAX_DIM.
+@param m runtime dimension
+@param[out] result return value of Kernel<m>::run, untouched if m is not handled
+@param args arguments forwarded to Kernel<m>::run
+@return true if a fixed-size kernel ran, false if the caller must use the general path
+*/
+template<template<int> class Kernel, typename Result, typename... Args>
+bool dispatchSmallMatrix(int m, Result & result, Args &&... args)
+{
+	switch (m)
+	{
+		case 2: result = Kernel<2>::run(std::forward<Args>(args)...); return true;
+		case 3: result = Kernel<3>::run(std::forward<Args>(args)...); return true;
+		case 4: result = Kernel<4>::run(std::forward<Args>(args)...); return true;
+		case 5: result = Kernel<5>::run(std::forward<Args>(args)...); return true;
+		case 6: result = Kernel<6>::run(std::forward<Args>(args)...); return true;
+		case 7: result = Kernel<7>::run(std::forward<Args>(args)...); return true;
+		case 8: result = Kernel<8>::run(std::forward<Args>(args)...); return true;
+		case 9: result = Kernel<9>::run(std::forward<Args>(args)...); return true;
+		case 10: result = Kernel<10>::run(std::forward<Args>(args)...); return true;
+		case 11: result = Kernel<11>::run(std::forward<Args>(args)...); return true;
+		case 12: result = Kernel<12>::run(std::forward<Args>(args)...); return true;
+		case 13: result = Kernel<13>::run(std::forward<Args>(args)...); return true;
+		case 14: result = Kernel<14>::run(std::forward<Args>(args)...); return true;
+		case 15: result = Kernel<15>::run(std::forward<Args>(args)...); return true;
+		case 16: result = Kernel<16>::run(std::forward<Args>(args)...); return true;
+		default: return false;
+	}
+}
+
+#endif /* SMALL_MATRIX_H */
@@ -0,0 +1,522 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file SparseEM.cpp
+*   \brief implementations for diagonal-covariance EM on sparse data
+*
+* With a diagonal covariance the log density of x under component g expands as
+*
+*     log N(x | mu_g, diag(v_g)) = c_g - 0.5 * sum_j (x_j*x_j - 2*x_j*mu_gj) / v_gj
+*
+* where c_g = -0.5*(m*log(2*pi) + sum_j log(v_gj) + sum_j mu_gj*mu_gj/v_gj) does not depend on x.
+* The sum only runs over the non-zeros of x, so with c_g computed once per EM iteration a
+* point is scored in O(nnz) per component.
+*
+* The M-step statistics are centered on the current means c_g, which keeps the variances well
+* conditioned when values are large relative to their spread. They only need the non-zeros too:
+* for each dimension j, the sums of r, r*(x_j - c_gj) and r*(x_j - c_gj)^2 over the points with
+* x_j != 0. The points with x_j == 0 are all at -c_gj, and their total responsibility is the
+* component's weight less the first of those sums.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <iostream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#ifdef UseMPI
+#include "mpi.h"
+#endif /* UseMPI */
+
+#include "SparseEM.h"
+#include "GaussMix.h"
+#include "Kernels.h"
+#include "Reduction.h"
+#include "EMDriver.h"
+
+using namespace std;
+
+#define DEBUG 0
+
+// number of data points per unit of work in the E-step and M-step
+#define SPARSE_BLOCK_SIZE 256
+
+/********************************************************************************************************
+ *                         PRIVATE TYPES AND FUNCTION PROTOTYPES
+ ********************************************************************************************************/
+
+namespace
+{
+
+/*! \brief per-component quantities the E-step needs, recomputed after each M-step */
+struct DiagonalComponents
+{
+    int k; ///< number of components
+    int m; ///< dimension
+    std::vector<double> inv_var; ///< 1/v_gj, k rows of m
+    std::vector<double> mu_inv_var; ///< mu_gj/v_gj, k rows of m
+    std::vector<double> log_const; ///< log(Pk_g) + c_g, one per component
+};
+
+/*! \brief M-step sufficient statistics of every component, over the non-zeros and centered on the current means */
+struct SparseStatistics
+{
+    SparseStatistics(int k, int m)
+        : k(k), m(m), weight(k, 0.0), nonzero_weight((std::size_t)k*m, 0.0), sum((std::size_t)k*m, 0.0),
+          squares((std::size_t)k*m, 0.0) {}
+
+    /** add another set of statistics (same k and m) to this one */
+    void add(const SparseStatistics & other);
+
+    int k; ///< number of components
+    int m; ///< dimension
+    std::vector<double> weight; ///< W_g = sum of r, one per component
+    std::vector<double> nonzero_weight; ///< sum of r over the points with x_j != 0, k rows of m
+    std::vector<double> sum; ///< sum of r*(x_j - c_gj) over those points, k rows of m
+    std::vector<double> squares; ///< sum of r*(x_j - c_gj)^2 over those points, k rows of m
+};
+
+bool prepare_components(int k, int m, const std::vector<double> & mu, const std::vector<double> & var,
+        const std::vector<double> & Pks, DiagonalComponents & components);
+
+void log_weighted_densities(const SparseMatrix & X, int row, const DiagonalComponents & components, double z[]);
+
+double estep_sparse(const SparseMatrix & X, const DiagonalComponents & components, std::vector<double> & resp);
+
+void reduceInto(SparseStatistics & total, const SparseStatistics & part);
+
+bool mstep_sparse(const SparseMatrix & X, int k, const std::vector<double> & resp, std::vector<double> & mu,
+        std::vector<double> & var, std::vector<double> & Pks);
+
+bool seed_sparse(const SparseMatrix & X, int k, std::vector<double> & mu, std::vector<double> & var,
+        std::vector<double> & Pks);
+
+/*! \brief the E and M steps runEM drives, over row-major parameters and n x k responsibilities */
+struct SparseSteps
+{
+    SparseSteps(const SparseMatrix & X, int k, std::vector<double> & mu, std::vector<double> & var,
+            std::vector<double> & Pks, std::vector<double> & resp, DiagonalComponents & components)
+        : X(X), k(k), mu(mu), var(var), Pks(Pks), resp(resp), components(components) {}
+
+    double estep() { return estep_sparse(X, components, resp); }
+    bool mstep()
+    {
+        return mstep_sparse(X, k, resp, mu, var, Pks) && prepare_components(k, X.colCount(), mu, var, Pks, components);
+    }
+
+    const SparseMatrix & X; ///< the data
+    int k; ///< number of components
+    std::vector<double> & mu; ///< means, k rows of m
+    std::vector<double> & var; ///< variances, k rows of m
+    std::vector<double> & Pks; ///< cluster weights
+    std::vector<double> & resp; ///< responsibilities of the last E-step
+    DiagonalComponents & components; ///< the prepared components of the parameters
+};
+
+/*************************************************************************************************************
+ *                            PRIVATE FUNCTIONS
+ **************************************************************************************************************/
+
+void SparseStatistics::add(const SparseStatistics & other)
+{
+    for (std::size_t i = 0; i < weight.size(); i++)
+        weight[i] += other.weight[i];
+    for (std::size_t i = 0; i < nonzero_weight.size(); i++)
+    {
+        nonzero_weight[i] += other.nonzero_weight[i];
+        sum[i] += other.sum[i];
+        squares[i] += other.squares[i];
+    }
+}
+
+/*! \brief reduceInto fold the sparse sums one thread gathered over its point blocks into another's */
+void reduceInto(SparseStatistics & total, const SparseStatistics & part)
+{
+    total.add(part);
+}
+
+/*! \brief prepare_components compute the point-independent part of each component's log density
+ *
+ * @param k number of components
+ * @param m dimension
+ * @param mu means, k rows of m
+ * @param var variances, k rows of m
+ * @param Pks cluster weights
+ * @param[out] components the prepared components
+ * @return true on success, false if a variance is not positive
+ */
+bool prepare_components(int k, int m, const std::vector<double> & mu, const std::vector<double> & var,
+        const std::vector<double> & Pks, DiagonalComponents & components)
+{
+    components.k = k;
+    components.m = m;
+    components.inv_var.resize((std::size_t)k*m);
+    components.mu_inv_var.resize((std::size_t)k*m);
+    components.log_const.resize(k);
+
+    for (int g = 0; g < k; g++)
+    {
+        double log_det = 0.0;
+        double mu_norm = 0.0;
+        for (int j = 0; j < m; j++)
+        {
+            std::size_t gj = (std::size_t)g*m + j;
+            if (!(var[gj] > 0.0))
+                return false;
+            components.inv_var[gj] = 1.0/var[gj];
+            components.mu_inv_var[gj] = mu[gj]/var[gj];
+            log_det += log(var[gj]);
+            mu_norm += mu[gj]*mu[gj]/var[gj];
+        }
+        components.log_const[g] = log(Pks[g]) - 0.5*(m*log(2*M_PI) + log_det + mu_norm);
+    }
+    return true;
+}
+
+/*! \brief log_weighted_densities log(Pk_g) + log N(x | mu_g, diag(v_g)) of one point under every component
+ *
+ * @param X sparse data
+ * @param row 0-rel row holding the point
+ * @param components prepared components
+ * @param[out] z k log weighted densities
+ */
+void log_weighted_densities(const SparseMatrix & X, int row, const DiagonalComponents & components, double z[])
+{
+    int nnz = X.rowNonZeros(row);
+    const int * columns = X.rowColumns(row);
+    const double * values = X.rowValues(row);
+
+    for (int g = 0; g < components.k; g++)
+    {
+        const double * inv_var = &components.inv_var[(std::size_t)g*components.m];
+        const double * mu_inv_var = &components.mu_inv_var[(std::size_t)g*components.m];
+        double sum = 0.0;
+        for (int e = 0; e < nnz; e++)
+        {
+            double x = values[e];
+            sum += x*(x*inv_var[columns[e]] - 2.0*mu_inv_var[columns[e]]);
+        }
+        z[g] = components.log_const[g] - 0.5*sum;
+    }
+}
+
+/*! \brief estep_sparse compute the responsibilities of every point and the log likelihood
+ *
+ * @param X n x m sparse data
+ * @param components prepared components
+ * @param[out] resp responsibilities, n x k column-major (one column of n per component)
+ * @return the log likelihood (over all nodes, under MPI)
+ */
+double estep_sparse(const SparseMatrix & X, const DiagonalComponents & components, std::vector<double> & resp)
+{
+    int n = X.rowCount();
+    int k = components.k;
+
+    // each block of points keeps its own likelihood, and they are summed in block order
+    int num_blocks = (n + SPARSE_BLOCK_SIZE - 1)/SPARSE_BLOCK_SIZE;
+    std::vector<double> block_likelihood(num_blocks, 0.0);
+#ifdef _OPENMP
+    # pragma omp parallel for schedule(static)
+#endif /* _OPENMP */
+    for (int block = 0; block < num_blocks; block++)
+    {
+        double z[k];
+        double partial = 0.0;
+        int end = std::min(n, (block+1)*SPARSE_BLOCK_SIZE);
+        for (int i = block*SPARSE_BLOCK_SIZE; i < end; i++)
+        {
+            log_weighted_densities(X, i, components, z);
+            partial += logNormalize(k, z);
+            for (int g = 0; g < k; g++)
+                resp[(std::size_t)g*n + i] = exp(z[g]);
+        }
+        block_likelihood[block] = partial;
+    }
+
+    double likelihood = 0.0;
+    for (int block = 0; block < num_blocks; block++)
+        likelihood += block_likelihood[block];
+
+#ifdef UseMPI
+    double totalLikelihood;
+    MPI_Allreduce(&likelihood, &totalLikelihood, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    likelihood = totalLikelihood;
+#endif /* UseMPI */
+
+    return likelihood;
+}
+
+/*! \brief mstep_sparse re-estimate weights, means and variances from the responsibilities
+ *
+ * @param X n x m sparse data
+ * @param k number of components
+ * @param resp responsibilities, n x k column-major
+ * @param[in,out] mu means, k rows of m: the statistics are centered on the ones passed in
+ * @param[out] var variances, k rows of m (floored at VARIANCE_FLOOR)
+ * @param[out] Pks cluster weights
+ * @return true on success, false if a component has lost all its points
+ */
+bool mstep_sparse(const SparseMatrix & X, int k, const std::vector<double> & resp, std::vector<double> & mu,
+        std::vector<double> & var, std::vector<double> & Pks)
+{
+    int n = X.rowCount();
+    int m = X.colCount();
+
+    // statistics per thread over its blocks of points, touching only the non-zeros, combined pairwise
+    std::vector<SparseStatistics> thread_stats(accumulatorCount(), SparseStatistics(k, m));
+    int num_blocks = (n + SPARSE_BLOCK_SIZE - 1)/SPARSE_BLOCK_SIZE;
+#ifdef _OPENMP
+    # pragma omp parallel
+#endif /* _OPENMP */
+    {
+        SparseStatistics & local = thread_stats[accumulatorIndex()];
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int end = std::min(n, (block+1)*SPARSE_BLOCK_SIZE);
+            for (int i = block*SPARSE_BLOCK_SIZE; i < end; i++)
+            {
+                int nnz = X.rowNonZeros(i);
+                const int * columns = X.rowColumns(i);
+                const double * values = X.rowValues(i);
+                for (int g = 0; g < k; g++)
+                {
+                    double r = resp[(std::size_t)g*n + i];
+                    if (r == 0.0)
+                        continue;
+                    local.weight[g] += r;
+                    std::size_t row = (std::size_t)g*m;
+                    for (int e = 0; e < nnz; e++)
+                    {
+                        std::size_t gj = row + columns[e];
+                        double d = values[e] - mu[gj];
+                        local.nonzero_weight[gj] += r;
+                        local.sum[gj] += r*d;
+                        local.squares[gj] += r*d*d;
+                    }
+                }
+            }
+        }
+    }
+    treeReduce(thread_stats);
+    SparseStatistics & stats = thread_stats[0];
+
+#ifdef UseMPI
+    MPI_Allreduce(MPI_IN_PLACE, &stats.weight[0], k, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.nonzero_weight[0], k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.sum[0], k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.squares[0], k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif /* UseMPI */
+
+    double total_weight = 0.0;
+    for (int g = 0; g < k; g++)
+        total_weight += stats.weight[g];
+
+    for (int g = 0; g < k; g++)
+    {
+        double w = stats.weight[g];
+        if (!(w > 0.0))
+        {
+            if (DEBUG)
+                cout << "Component " << g << " has no points left" << endl;
+            return false;
+        }
+        Pks[g] = w/total_weight;
+        for (int j = 0; j < m; j++)
+        {
+            std::size_t gj = (std::size_t)g*m + j;
+            double c = mu[gj];
+
+            // fold in the points that are zero in dimension j, each at -c from the center
+            double zero_weight = std::max(w - stats.nonzero_weight[gj], 0.0);
+            double sum = stats.sum[gj] - zero_weight*c;
+            double squares = stats.squares[gj] + zero_weight*c*c;
+
+            // the new mean is c + delta, and the variance about it is the centered second moment less delta^2
+            double delta = sum/w;
+            mu[gj] = c + delta;
+            double v = squares/w - delta*delta;
+            var[gj] = (v > VARIANCE_FLOOR) ? v : VARIANCE_FLOOR;
+        }
+    }
+    return true;
+}
+
+/*! \brief seed_sparse initial parameters: means are k distinct random data points, every component
+ * gets the (floored) variance of the whole data set, and the weights are equal
+ *
+ * @param X n x m sparse data
+ * @param k number of components
+ * @param[out] mu means, k rows of m
+ * @param[out] var variances, k rows of m
+ * @param[out] Pks cluster weights
+ * @return true on success, false if there are fewer than k points
+ */
+bool seed_sparse(const SparseMatrix & X, int k, std::vector<double> & mu, std::vector<double> & var,
+        std::vector<double> & Pks)
+{
+    int n = X.rowCount();
+    int m = X.colCount();
+    int myNode = 0;
+#ifdef UseMPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &myNode);
+#endif /* UseMPI */
+
+    // variance of the whole data set: a single component with every responsibility 1. The first
+    // pass (centered on 0) finds the mean, and the second is centered on it
+    std::vector<double> ones(n, 1.0);
+    std::vector<double> all_mu(m, 0.0), all_var(m), all_Pk(1);
+    if (!mstep_sparse(X, 1, ones, all_mu, all_var, all_Pk) || !mstep_sparse(X, 1, ones, all_mu, all_var, all_Pk))
+        return false;
+
+    // the means are picked (from its own rows) by node 0 and shared
+    int ok = 1;
+    if (myNode == 0)
+    {
+        if (n < k)
+        {
+            std::cout << "Training data is less than number of clusters results in ill-defined matrix." << std::endl;
+            ok = 0;
+        }
+        else
+        {
+            if (DEBUG)
+                srand(5);
+            else
+                srand(time(NULL));
+
+            std::set<int> choices;
+            for (int g = 0; g < k; g++)
+            {
+                int row;
+                do
+                {
+                    row = rand() % n;
+                } while (choices.find(row) != choices.end());
+                choices.insert(row);
+
+                for (int j = 0; j < m; j++)
+                    mu[(std::size_t)g*m + j] = 0.0;
+                int nnz = X.rowNonZeros(row);
+                for (int e = 0; e < nnz; e++)
+                    mu[(std::size_t)g*m + X.rowColumns(row)[e]] = X.rowValues(row)[e];
+            }
+        }
+    }
+#ifdef UseMPI
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (ok)
+        MPI_Bcast(&mu[0], k*m, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif /* UseMPI */
+    if (!ok)
+        return false;
+
+    for (int g = 0; g < k; g++)
+    {
+        Pks[g] = 1.0/k;
+        for (int j = 0; j < m; j++)
+            var[(std::size_t)g*m + j] = all_var[j];
+    }
+    return true;
+}
+
+} // namespace
+
+/******************************************************************
+ *                        IMPLEMENTATIONS OF PUBLIC FUNCTIONS
+ ******************************************************************/
+
+int gaussmix::train_sparse_diagonal(int k, int max_iters, const SparseMatrix & X, Matrix & variance_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    int n = X.rowCount();
+    int m = X.colCount();
+
+    if (k < 1 || variance_matrix.rowCount() != k || variance_matrix.colCount() != m ||
+            mu_matrix.rowCount() != k || mu_matrix.colCount() != m)
+    {
+        if (DEBUG)
+            std::cout << "Error: variance and mean matrices must be k x m" << std::endl;
+        return GAUSSMIX_GENERAL_ERROR;
+    }
+
+    //parameters, row-major (one row of m per component), and the n x k responsibilities
+    std::vector<double> mu((std::size_t)k*m), var((std::size_t)k*m), resp((std::size_t)n*k);
+    Pks.assign(k, 0.0);
+
+    if (!seed_sparse(X, k, mu, var, Pks))
+        return GAUSSMIX_GENERAL_ERROR;
+
+    DiagonalComponents components;
+    prepare_components(k, m, mu, var, Pks, components);
+    SparseSteps steps(X, k, mu, var, Pks, resp, components);
+    int condition = runEM(steps, max_iters, op_likelihood);
+
+    for (int g = 0; g < k; g++)
+        for (int j = 0; j < m; j++)
+        {
+            mu_matrix.update(mu[(std::size_t)g*m + j], g, j);
+            variance_matrix.update(var[(std::size_t)g*m + j], g, j);
+        }
+
+    return condition;
+}
+
+double gaussmix::pdf_mix_sparse_diagonal(const SparseMatrix & X, int row, const Matrix & variance_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks)
+{
+    int k = mu_matrix.rowCount();
+    int m = mu_matrix.colCount();
+
+    std::vector<double> mu((std::size_t)k*m), var((std::size_t)k*m);
+    for (int g = 0; g < k; g++)
+        for (int j = 0; j < m; j++)
+        {
+            mu[(std::size_t)g*m + j] = mu_matrix.getValue(g,j);
+            var[(std::size_t)g*m + j] = variance_matrix.getValue(g,j);
+        }
+
+    DiagonalComponents components;
+    if (!prepare_components(k, m, mu, var, Pks, components))
+        throw LapackError("Error: variances must be positive");
+
+    double z[k];
+    log_weighted_densities(X, row, components, z);
+    return logSumExp(k, z);
+}
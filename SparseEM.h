@@ -0,0 +1,78 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file SparseEM.h
+*   \brief definitions for EM training and scoring of diagonal-covariance GMMs on sparse data
+*/
+
+#ifndef SPARSE_EM_H_
+#define SPARSE_EM_H_
+
+#include <vector>
+
+#include "Matrix.h"
+#include "SparseMatrix.h"
+
+
+namespace gaussmix
+{
+
+/*! \brief train_sparse_diagonal: train a diagonal-covariance Gaussian Mixture model on sparse data.
+*
+* Each E-step and M-step costs O(k * nnz) for the data, plus O(k * m) for the parameters, so
+* dimensions that are zero in a point cost nothing for that point.
+*
+@param[in] k number of clusters
+@param[in] max_iters max number of EM iterations
+@param[in] X n x m sparse data points (local rows, under MPI)
+@param[out] variance_matrix k x m matrix of the diagonals of the covariances (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes
+*/
+int train_sparse_diagonal(int k, int max_iters, const SparseMatrix & X, Matrix & variance_matrix,
+		Matrix & mu_matrix, std::vector<double> & Pks, double * likelihood);
+
+/*! \brief pdf_mix_sparse_diagonal: log of the mixture density of a sparse data point under a diagonal-covariance GMM
+*
+@param[in] X sparse data
+@param[in] row 0-rel row of X holding the data point
+@param[in] variance_matrix k x m matrix of the diagonals of the covariances
+@param[in] mu_matrix k x m matrix of cluster means
+@param[in] Pks cluster weights
+@return log likelihood
+*/
+double pdf_mix_sparse_diagonal(const SparseMatrix & X, int row, const Matrix & variance_matrix,
+		const Matrix & mu_matrix, const std::vector<double> & Pks);
+
+}
+
+#endif /* SPARSE_EM_H_ */
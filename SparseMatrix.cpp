@@ -0,0 +1,132 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file SparseMatrix.cpp
+*   \brief SparseMatrix class method implementations.
+*/
+
+#include <algorithm>
+
+#include "SparseMatrix.h"
+
+
+/**
+\brief create an empty matrix
+@param cols number of columns
+*/
+SparseMatrix::SparseMatrix(int cols)
+    : numCols(cols), rowStart(1, 0)
+{
+}
+
+/**
+\brief make room for rows and non-zeros
+@param rows expected number of rows
+@param nonZeros expected number of non-zeros
+*/
+void SparseMatrix::reserve(int rows, std::size_t nonZeros)
+{
+    rowStart.reserve(rows + 1);
+    columnIndex.reserve(nonZeros);
+    values.reserve(nonZeros);
+}
+
+/**
+\brief append a row given its non-zeros
+@param count number of entries
+@param columns 0-rel columns, strictly increasing
+@param vals values
+*/
+void SparseMatrix::appendRow(int count, const int columns[], const double vals[]) throw (SizeError)
+{
+    for (int e = 0; e < count; e++)
+    {
+        if (columns[e] < 0 || columns[e] >= numCols)
+            throw SizeError("Error: sparse row has a column out of range");
+        if (e > 0 && columns[e] <= columns[e-1])
+            throw SizeError("Error: sparse row columns are not strictly increasing");
+    }
+    for (int e = 0; e < count; e++)
+    {
+        if (vals[e] != 0.0)
+        {
+            columnIndex.push_back(columns[e]);
+            values.push_back(vals[e]);
+        }
+    }
+    rowStart.push_back(values.size());
+}
+
+/**
+\brief append a dense row, keeping its non-zeros
+@param row colCount() values
+*/
+void SparseMatrix::appendDenseRow(const double row[])
+{
+    for (int j = 0; j < numCols; j++)
+    {
+        if (row[j] != 0.0)
+        {
+            columnIndex.push_back(j);
+            values.push_back(row[j]);
+        }
+    }
+    rowStart.push_back(values.size());
+}
+
+/**
+\brief get an element
+@param i 0-rel row
+@param j 0-rel column
+@return the element (0 if not stored)
+*/
+double SparseMatrix::getValue(int i, int j) const throw (SizeError)
+{
+    if (i < 0 || i >= rowCount() || j < 0 || j >= numCols)
+        throw SizeError("Error: attempt to read a non-existent element of a sparse matrix");
+
+    std::vector<int>::const_iterator first = columnIndex.begin() + rowStart[i];
+    std::vector<int>::const_iterator last = columnIndex.begin() + rowStart[i+1];
+    std::vector<int>::const_iterator found = std::lower_bound(first, last, j);
+    return (found != last && *found == j) ? values[found - columnIndex.begin()] : 0.0;
+}
+
+/**
+\brief expand into a dense matrix
+@return the dense matrix
+*/
+Matrix SparseMatrix::toMatrix() const
+{
+    Matrix M(rowCount(), numCols);
+    for (int i = 0; i < rowCount(); i++)
+        for (std::size_t e = rowStart[i]; e < rowStart[i+1]; e++)
+            M.update(values[e], i, columnIndex[e]);
+    return M;
+}
@@ -0,0 +1,108 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file SparseMatrix.h
+*   \brief Definitions for a sparse matrix held in compressed sparse row (CSR) form
+*/
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Matrix.h"
+
+
+/*! \brief rows x cols matrix storing only its non-zero entries, row by row (CSR)
+*
+* The non-zeros of row i are values[rowStart[i] .. rowStart[i+1]-1], in increasing column order,
+* with their 0-rel columns in the same positions of columnIndex. Memory and the cost of a pass
+* over the data are O(nnz) rather than O(rows*cols), which is what makes high-dimensional,
+* mostly-zero data (e.g. libsvm files) tractable. Rows are appended one at a time, like MatrixBuilder.
+*/
+class SparseMatrix
+{
+	public:
+	/** create an empty (0 row) matrix with a given number of columns
+	@param cols number of columns*/
+	explicit SparseMatrix(int cols=0);
+
+	/** make room for rows and non-zeros without further reallocation
+	@param rows expected number of rows
+	@param nonZeros expected number of non-zero entries*/
+	void reserve(int rows, std::size_t nonZeros);
+
+	/** append a row given its non-zero entries (explicit zeros are dropped)
+	@param count number of entries
+	@param columns 0-rel columns of the entries, strictly increasing
+	@param values values of the entries
+	@throw SizeError if a column is out of range or the columns are not strictly increasing*/
+	void appendRow(int count, const int columns[], const double values[]) throw (SizeError);
+
+	/** append a dense row, keeping its non-zeros
+	@param row colCount() values*/
+	void appendDenseRow(const double row[]);
+
+	/**@return the number of rows*/
+	int rowCount() const { return (int)rowStart.size() - 1; }
+
+	/**@return the number of columns*/
+	int colCount() const { return numCols; }
+
+	/**@return the number of stored (non-zero) entries*/
+	std::size_t nonZeroCount() const { return values.size(); }
+
+	/** @param i 0-rel row
+	@return the number of non-zeros in row i*/
+	int rowNonZeros(int i) const { return (int)(rowStart[i+1] - rowStart[i]); }
+
+	/** @param i 0-rel row
+	@return the (increasing) 0-rel columns of the non-zeros of row i*/
+	const int * rowColumns(int i) const { return columnIndex.empty() ? 0 : &columnIndex[rowStart[i]]; }
+
+	/** @param i 0-rel row
+	@return the values of the non-zeros of row i*/
+	const double * rowValues(int i) const { return values.empty() ? 0 : &values[rowStart[i]]; }
+
+	/**@return the element in ith row, jth column (indexed from 0); O(log(nnz in row))*/
+	double getValue(int i, int j) const throw (SizeError);
+
+	/** expand into a dense matrix
+	@return rowCount() x colCount() matrix*/
+	Matrix toMatrix() const;
+
+	private:
+	int numCols; ///< number of columns
+	std::vector<std::size_t> rowStart; ///< offset of each row's first non-zero, plus one past the end
+	std::vector<int> columnIndex; ///< column of each non-zero
+	std::vector<double> values; ///< value of each non-zero
+};
+
+#endif //SPARSE_MATRIX_H
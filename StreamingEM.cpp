@@ -0,0 +1,395 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file StreamingEM.cpp
+*   \brief implementations for full-covariance EM that streams over the data without storing responsibilities
+*
+* gaussmix_train keeps an n x k matrix of log responsibilities: estep writes it, and mstep reads
+* it back (and exponentiates it) once for the means and again for the covariances. Here each
+* block of points is scored and its responsibilities r are used at once, to add to
+*
+*     W_g = sum r,    S_g = sum r*(x - c_g),    Q_g = sum r*(x - c_g)*(x - c_g)'
+*
+* for every component g, where c_g is the component's current mean. The new mean is then
+* c_g + S_g/W_g and the scatter about it Q_g - S_g*S_g'/W_g. Centering on c_g (rather than
+* accumulating raw x*x') keeps the subtraction well conditioned, since c_g is close to the new mean.
+* For a block, S_g is one matrix-vector product and Q_g one symmetric rank-k update (DSYRK) of the
+* centered points scaled by sqrt(r). Q_g is kept packed (SymmetricMatrix layout), so the per-thread
+* statistics and their reduction are k*m*(m+1)/2 rather than k*m*m.
+*/
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cblas.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#ifdef UseMPI
+#include "mpi.h"
+#endif /* UseMPI */
+
+#include "StreamingEM.h"
+#include "GaussMix.h"
+#include "KMeans.h"
+#include "Kernels.h"
+#include "Reduction.h"
+#include "SymmetricMatrix.h"
+#include "EMDriver.h"
+
+using namespace std;
+
+#define DEBUG 0
+
+// number of data points scored and folded into the statistics together
+#define STREAM_BLOCK_SIZE 256
+
+/********************************************************************************************************
+ *                         PRIVATE TYPES AND FUNCTION PROTOTYPES
+ ********************************************************************************************************/
+
+namespace
+{
+
+/*! \brief EM sufficient statistics of every component, about the component means they were centered on */
+struct SufficientStatistics
+{
+	SufficientStatistics(int k, int m)
+		: k(k), m(m), weight(k, 0.0), sum((std::size_t)k*m, 0.0), scatter(k*SymmetricMatrix::packedLength(m), 0.0) {}
+
+	/** add another set of statistics (same k and m) to this one */
+	void add(const SufficientStatistics & other);
+
+	int k; ///< number of components
+	int m; ///< dimension
+	std::vector<double> weight; ///< W_g = sum of r, one per component
+	std::vector<double> sum; ///< S_g = sum of r*(x - c_g), k rows of m
+	std::vector<double> scatter; ///< Q_g = sum of r*(x - c_g)*(x - c_g)', k packed m x m (upper triangles)
+};
+
+template<typename T>
+double accumulate_statistics(const BasicMatrixView<T> & X, const std::vector<Matrix*> & sigma_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks, SufficientStatistics & stats);
+
+void reduceInto(SufficientStatistics & total, const SufficientStatistics & part);
+
+bool update_parameters(const SufficientStatistics & stats, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks);
+
+/*! \brief the E and M steps runEM drives: a pass over the data, then an update from its statistics */
+template<typename T>
+struct StreamingSteps
+{
+	StreamingSteps(const BasicMatrixView<T> & X, std::vector<Matrix*> & sigma_matrix, Matrix & mu_matrix,
+			std::vector<double> & Pks)
+		: X(X), sigma_matrix(sigma_matrix), mu_matrix(mu_matrix), Pks(Pks), stats(mu_matrix.rowCount(), X.colCount()) {}
+
+	double estep() { return accumulate_statistics(X, sigma_matrix, mu_matrix, Pks, stats); }
+	bool mstep() { return update_parameters(stats, sigma_matrix, mu_matrix, Pks); }
+
+	const BasicMatrixView<T> & X; ///< the data
+	std::vector<Matrix*> & sigma_matrix; ///< covariances
+	Matrix & mu_matrix; ///< means
+	std::vector<double> & Pks; ///< cluster weights
+	SufficientStatistics stats; ///< statistics of the last pass
+};
+
+template<typename T>
+int train_streaming_view(int k, int max_iters, const BasicMatrixView<T> & X, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood);
+
+/*************************************************************************************************************
+ *                            PRIVATE FUNCTIONS
+ **************************************************************************************************************/
+
+void SufficientStatistics::add(const SufficientStatistics & other)
+{
+    for (std::size_t i = 0; i < weight.size(); i++)
+        weight[i] += other.weight[i];
+    for (std::size_t i = 0; i < sum.size(); i++)
+        sum[i] += other.sum[i];
+    for (std::size_t i = 0; i < scatter.size(); i++)
+        scatter[i] += other.scatter[i];
+}
+
+/*! \brief reduceInto merge one thread's share of a pass into another's, the pairwise step of treeReduce */
+void reduceInto(SufficientStatistics & total, const SufficientStatistics & part)
+{
+    total.add(part);
+}
+
+/*! \brief accumulate_statistics one pass over the data: score every point under the current model and
+ *  fold its responsibilities into the sufficient statistics
+ *
+ * @param X view of the n x m data
+ * @param sigma_matrix current covariances
+ * @param mu_matrix current means (the statistics are centered on them)
+ * @param Pks current cluster weights
+ * @param[out] stats the statistics (over all nodes, under MPI)
+ * @return the log likelihood of the data under the current model (over all nodes, under MPI)
+ * @throw LapackError if a covariance is not positive definite
+ */
+template<typename T>
+double accumulate_statistics(const BasicMatrixView<T> & X, const std::vector<Matrix*> & sigma_matrix,
+        const Matrix & mu_matrix, const std::vector<double> & Pks, SufficientStatistics & stats)
+{
+    int n = X.rowCount();
+    int m = stats.m;
+    int k = stats.k;
+    std::size_t packed = SymmetricMatrix::packedLength(m);
+
+    CholeskyBatch factors(sigma_matrix);
+    const double * log_norm_factors = factors.logNormalizers();
+
+    std::vector<double> mu_rows((std::size_t)k*m);
+    std::vector<double> log_Pks(k);
+    for (int g = 0; g < k; g++)
+    {
+        for (int j = 0; j < m; j++)
+            mu_rows[(std::size_t)g*m + j] = mu_matrix.getValue(g,j);
+        log_Pks[g] = log(Pks[g]);
+    }
+
+    // one set of statistics per thread, combined pairwise afterwards so that the result is the
+    // same from run to run
+    std::vector<SufficientStatistics> thread_stats(accumulatorCount(), SufficientStatistics(k, m));
+
+    int num_blocks = (n + STREAM_BLOCK_SIZE - 1)/STREAM_BLOCK_SIZE;
+    std::vector<double> block_likelihood(num_blocks, 0.0);
+
+#ifdef _OPENMP
+    # pragma omp parallel
+#endif /* _OPENMP */
+    {
+        SufficientStatistics & local = thread_stats[accumulatorIndex()];
+
+        std::vector<double> points((std::size_t)STREAM_BLOCK_SIZE*m);
+        std::vector<double> work((std::size_t)STREAM_BLOCK_SIZE*m);
+        std::vector<double> distances(STREAM_BLOCK_SIZE);
+        std::vector<double> z((std::size_t)STREAM_BLOCK_SIZE*k);
+        std::vector<double> r(STREAM_BLOCK_SIZE);
+        std::vector<double> block_scatter((std::size_t)m*m);
+
+#ifdef _OPENMP
+        # pragma omp for schedule(static)
+#endif /* _OPENMP */
+        for (int block = 0; block < num_blocks; block++)
+        {
+            int first = block*STREAM_BLOCK_SIZE;
+            int count = std::min(STREAM_BLOCK_SIZE, n - first);
+            X.copyRowBlock(first, count, &points[0], count);
+
+            // log responsibilities of the block: a row of k per point
+            for (int g = 0; g < k; g++)
+            {
+                factors.mahalanobisBlock(g, count, &points[0], count, &mu_rows[(std::size_t)g*m], &work[0], &distances[0]);
+                for (int i = 0; i < count; i++)
+                    z[(std::size_t)i*k + g] = log_Pks[g] + log_norm_factors[g] - 0.5*distances[i];
+            }
+            double partial = 0.0;
+            for (int i = 0; i < count; i++)
+                partial += logNormalize(k, &z[(std::size_t)i*k]);
+            block_likelihood[block] = partial;
+
+            // fold them into the statistics, a component at a time
+            for (int g = 0; g < k; g++)
+            {
+                double w = 0.0;
+                for (int i = 0; i < count; i++)
+                {
+                    r[i] = exp(z[(std::size_t)i*k + g]);
+                    w += r[i];
+                }
+                local.weight[g] += w;
+
+                // center the block on the current mean
+                const double * c = &mu_rows[(std::size_t)g*m];
+                for (int j = 0; j < m; j++)
+                {
+                    const double * x = &points[(std::size_t)j*count];
+                    double * d = &work[(std::size_t)j*count];
+                    for (int i = 0; i < count; i++)
+                        d[i] = x[i] - c[j];
+                }
+
+                // S_g += (x - c)' * r
+                cblas_dgemv(CblasColMajor, CblasTrans, count, m, 1.0, &work[0], count, &r[0], 1,
+                        1.0, &local.sum[(std::size_t)g*m], 1);
+
+                // Q_g += (sqrt(r) .* (x - c))' * (sqrt(r) .* (x - c))
+                for (int i = 0; i < count; i++)
+                    r[i] = sqrt(r[i]);
+                for (int j = 0; j < m; j++)
+                {
+                    double * d = &work[(std::size_t)j*count];
+                    for (int i = 0; i < count; i++)
+                        d[i] *= r[i];
+                }
+                cblas_dsyrk(CblasColMajor, CblasUpper, CblasTrans, m, count, 1.0, &work[0], count,
+                        0.0, &block_scatter[0], m);
+                SymmetricMatrix::addUpper(m, &block_scatter[0], m, &local.scatter[g*packed]);
+            }
+        }
+    }
+
+    treeReduce(thread_stats);
+    stats = thread_stats[0];
+
+    double likelihood = 0.0;
+    for (int block = 0; block < num_blocks; block++)
+        likelihood += block_likelihood[block];
+
+#ifdef UseMPI
+    double total_likelihood;
+    MPI_Allreduce(&likelihood, &total_likelihood, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    likelihood = total_likelihood;
+    MPI_Allreduce(MPI_IN_PLACE, &stats.weight[0], k, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.sum[0], k*m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats.scatter[0], (int)(k*packed), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif /* UseMPI */
+
+    return likelihood;
+}
+
+/*! \brief update_parameters the M-step: new weights, means and covariances from the statistics
+ *
+ * The covariances get the same scaling as mstep in GaussMix.cpp, so both training modes
+ * produce the same models.
+ *
+ * @param stats sufficient statistics, centered on the current means
+ * @param[in,out] sigma_matrix covariances
+ * @param[in,out] mu_matrix means
+ * @param[out] Pks cluster weights
+ * @return true on success, false if a component is empty or a covariance is not positive definite
+ */
+bool update_parameters(const SufficientStatistics & stats, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks)
+{
+    int k = stats.k;
+    int m = stats.m;
+    std::size_t packed = SymmetricMatrix::packedLength(m);
+
+    double total_weight = 0.0;
+    for (int g = 0; g < k; g++)
+        total_weight += stats.weight[g];
+
+    for (int g = 0; g < k; g++)
+    {
+        double w = stats.weight[g];
+        if (!(w > 0.0))
+            return false;
+        Pks[g] = w/total_weight;
+
+        // the new mean is c + delta
+        double delta[m];
+        for (int j = 0; j < m; j++)
+        {
+            delta[j] = stats.sum[(std::size_t)g*m + j]/w;
+            mu_matrix.update(mu_matrix.getValue(g,j) + delta[j], g, j);
+        }
+
+        // scatter about the new mean, Q - w*delta*delta', scaled as in mstep
+        const double * Q = &stats.scatter[g*packed];
+        double scale = 1.0/(2*Pks[g]*w);
+        Matrix & sigma = *sigma_matrix[g];
+        std::size_t p = 0;
+        for (int j = 0; j < m; j++)
+            for (int i = 0; i <= j; i++)
+            {
+                double value = (Q[p++] - w*delta[i]*delta[j])*scale;
+                sigma.update(value, i, j);
+                sigma.update(value, j, i);
+            }
+
+        try
+        {
+            Cholesky factor(sigma);
+        }
+        catch (LapackError &)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+int train_streaming_view(int k, int max_iters, const BasicMatrixView<T> & X, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    int m = X.colCount();
+
+    if (k < 1 || (int)sigma_matrix.size() != k || mu_matrix.rowCount() != k || mu_matrix.colCount() != m)
+        return gaussmix::GAUSSMIX_GENERAL_ERROR;
+    for (int g = 0; g < k; g++)
+        if (sigma_matrix[g]->rowCount() != m || sigma_matrix[g]->colCount() != m)
+            return gaussmix::GAUSSMIX_GENERAL_ERROR;
+
+    //start where gaussmix_train does: kmeans means, identity covariances and equal weights
+    double * kmeans_mu = gaussmix::kmeans(X, k);
+    if (0 == kmeans_mu)
+        return gaussmix::GAUSSMIX_GENERAL_ERROR;
+    for (int g = 0; g < k; g++)
+    {
+        for (int j = 0; j < m; j++)
+        {
+            mu_matrix.update(kmeans_mu[g*m + j], g, j);
+            for (int i = 0; i < m; i++)
+                sigma_matrix[g]->update((i == j) ? 1.0 : 0.0, i, j);
+        }
+    }
+    delete[] kmeans_mu;
+    Pks.assign(k, 1.0/k);
+
+    //each pass scores the data under the parameters the previous one produced
+    StreamingSteps<T> steps(X, sigma_matrix, mu_matrix, Pks);
+    return runEM(steps, max_iters, op_likelihood);
+}
+
+} // namespace
+
+/******************************************************************
+ *                        IMPLEMENTATIONS OF PUBLIC FUNCTIONS
+ ******************************************************************/
+
+int gaussmix::train_streaming(int k, int max_iters, const MatrixView & X, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    return train_streaming_view(k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood);
+}
+
+int gaussmix::train_streaming(int k, int max_iters, const FloatMatrixView & X, std::vector<Matrix*> & sigma_matrix,
+        Matrix & mu_matrix, std::vector<double> & Pks, double * op_likelihood)
+{
+    return train_streaming_view(k, max_iters, X, sigma_matrix, mu_matrix, Pks, op_likelihood);
+}
@@ -0,0 +1,74 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file StreamingEM.h
+*   \brief definitions for full-covariance EM that streams over the data without storing responsibilities
+*/
+
+#ifndef STREAMING_EM_H_
+#define STREAMING_EM_H_
+
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+
+
+namespace gaussmix
+{
+
+/*! \brief train_streaming: train a full-covariance Gaussian Mixture model, one pass over the data per iteration
+*
+* Each pass scores a block of points, turns the scores into responsibilities and folds them straight
+* into per-thread sufficient statistics (sum of r, r*x and r*x*x' per component), so the n x k
+* responsibility matrix of gaussmix_train is never stored: memory is O(k*m*m) per thread whatever n is.
+* Starts from the same kmeans means, identity covariances and equal weights as gaussmix_train, and
+* computes the same updates.
+*
+@param[in] k number of clusters
+@param[in] max_iters max number of EM iterations
+@param[in] X n x m data points (local rows, under MPI)
+@param[out] sigma_matrix k m x m covariance matrices (caller allocates)
+@param[out] mu_matrix k x m matrix of cluster means (caller allocates)
+@param[out] Pks cluster weights
+@param[out] likelihood the log likelihood (density) of the data
+@return one of the GAUSSMIX_ condition codes
+*/
+int train_streaming(int k, int max_iters, const MatrixView & X, std::vector<Matrix*> & sigma_matrix,
+		Matrix & mu_matrix, std::vector<double> & Pks, double * likelihood);
+
+/*! \brief train_streaming: as above, for float32 data (statistics are accumulated in double)
+*/
+int train_streaming(int k, int max_iters, const FloatMatrixView & X, std::vector<Matrix*> & sigma_matrix,
+		Matrix & mu_matrix, std::vector<double> & Pks, double * likelihood);
+
+}
+
+#endif /* STREAMING_EM_H_ */
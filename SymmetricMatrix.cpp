@@ -0,0 +1,135 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file SymmetricMatrix.cpp
+*   \brief SymmetricMatrix class method implementations.
+*/
+
+#include <cblas.h>
+
+#include "SymmetricMatrix.h"
+
+
+/**
+\brief create an n x n matrix of zeros
+@param n dimension
+*/
+SymmetricMatrix::SymmetricMatrix(int n)
+    : dim(n), entries((std::size_t)n*(n+1)/2, 0.0)
+{
+}
+
+/**
+\brief pack the upper triangle of a square matrix
+@param A square matrix
+*/
+SymmetricMatrix::SymmetricMatrix(const Matrix & A) throw (SizeError)
+    : dim(A.rowCount()), entries((std::size_t)A.rowCount()*(A.rowCount()+1)/2)
+{
+    if (A.rowCount()!=A.colCount())
+        throw SizeError((char*)"Error: tried to pack a non-square matrix as symmetric");
+
+    const double * a = A.getArray();
+    std::size_t p = 0;
+    for (int j=0; j<dim; j++)
+        for (int i=0; i<=j; i++)
+            entries[p++] = a[(std::size_t)j*dim + i];
+}
+
+/**
+\brief unpack into a full square matrix
+@param[out] A dim x dim matrix to overwrite
+*/
+void SymmetricMatrix::copyTo(Matrix & A) const throw (SizeError)
+{
+    if (A.rowCount()!=dim || A.colCount()!=dim)
+        throw SizeError((char*)"Error: tried to unpack a symmetric matrix into a matrix of the wrong size");
+
+    double * a = A.getArray();
+    std::size_t p = 0;
+    for (int j=0; j<dim; j++)
+        for (int i=0; i<=j; i++)
+        {
+            a[(std::size_t)j*dim + i] = entries[p];
+            a[(std::size_t)i*dim + j] = entries[p];
+            p++;
+        }
+}
+
+/**
+\brief symmetric rank-1 update: this += alpha*x*x'
+@param alpha scalar multiplier
+@param x vector of length dimension()
+*/
+void SymmetricMatrix::spr(double alpha, const double x[])
+{
+    if (dim==0)
+        return;
+    cblas_dspr(CblasColMajor, CblasUpper, dim, alpha, x, 1, &entries[0]);
+}
+
+/**
+\brief multiply every entry by a scalar
+@param alpha multiplier
+*/
+void SymmetricMatrix::scale(double alpha)
+{
+    for (std::size_t p=0; p<entries.size(); p++)
+        entries[p] *= alpha;
+}
+
+/**
+\brief add the upper triangle of a square matrix to packed entries
+@param n dimension
+@param A n x n column-major matrix
+@param lda leading dimension of A
+@param[in,out] packed packedLength(n) entries
+*/
+void SymmetricMatrix::addUpper(int n, const double A[], int lda, double packed[])
+{
+    std::size_t p = 0;
+    for (int j=0; j<n; j++)
+    {
+        const double * a = A + (std::size_t)j*lda;
+        for (int i=0; i<=j; i++)
+            packed[p++] += a[i];
+    }
+}
+
+/**
+\brief Cholesky factor (the factor itself is a full lower triangular Matrix)
+@return the factorization
+*/
+Cholesky SymmetricMatrix::cholesky() const throw (SizeError, LapackError)
+{
+    Matrix A(dim, dim);
+    copyTo(A);
+    return Cholesky(A);
+}
@@ -0,0 +1,141 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+
+/*! \file SymmetricMatrix.h
+*   \brief Definitions for a symmetric matrix held in packed (upper triangle) storage
+*/
+#ifndef SYMMETRIC_MATRIX_H
+#define SYMMETRIC_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Matrix.h"
+
+
+/*! \brief symmetric dim x dim matrix storing only its upper triangle
+*
+* The m*(m+1)/2 entries are kept in LAPACK/BLAS packed upper column-major order: element
+* (i,j), i<=j, is at entries[i + j*(j+1)/2]. Covariances are symmetric, so this halves their
+* memory and the flops of accumulating them, and reductions over covariances move half the data.
+* Accumulators that hold several of them back to back use the same layout (see packedLength and
+* addUpper). Convert to a full Matrix (copyTo) where a full square is needed.
+*/
+class SymmetricMatrix
+{
+	public:
+	/** create an n x n matrix of zeros
+	@param n dimension*/
+	explicit SymmetricMatrix(int n=0);
+
+	/** pack a square matrix (only the upper triangle is read)
+	@param A square matrix
+	@throw SizeError if A is not square*/
+	explicit SymmetricMatrix(const Matrix & A) throw (SizeError);
+
+	/** write the full square matrix into A
+	@param[out] A dim x dim matrix to overwrite
+	@throw SizeError if A is not dim x dim*/
+	void copyTo(Matrix & A) const throw (SizeError);
+
+	/**@return the dimension*/
+	int dimension() const { return dim; }
+
+	/**@return the number of stored entries, dim*(dim+1)/2*/
+	std::size_t packedSize() const { return entries.size(); }
+
+	/** get value
+	@param i 0-rel row
+	@param j 0-rel column (either triangle may be addressed)
+	@return value at (i,j) and (j,i)*/
+	double getValue(int i, int j) const { return entries[index(i,j)]; }
+
+	/** set value at (i,j) and (j,i)
+	@param value new value
+	@param i 0-rel row
+	@param j 0-rel column*/
+	void update(double value, int i, int j) throw (SizeError)
+	{
+		if (i<0 || j<0 || i>=dim || j>=dim)
+			throw SizeError("Error: symmetric matrix index out of range");
+		entries[index(i,j)] = value;
+	}
+
+	/**@return the packed entries (packedSize() of them)*/
+	double * getArray() { return entries.empty() ? 0 : &entries[0]; }
+
+	/**@return the packed entries (read-only)*/
+	const double * getArray() const { return entries.empty() ? 0 : &entries[0]; }
+
+	/** symmetric rank-1 update (blas dspr): this += alpha*x*x'
+	@param alpha scalar multiplier
+	@param x vector of length dimension()*/
+	void spr(double alpha, const double x[]);
+
+	/** multiply every entry by a scalar
+	@param alpha multiplier*/
+	void scale(double alpha);
+
+	/**@return the number of packed entries of an n x n symmetric matrix, n*(n+1)/2
+	@param n dimension*/
+	static std::size_t packedLength(int n) { return (std::size_t)n*(n+1)/2; }
+
+	/** add the upper triangle of a square column-major matrix to packed entries: packed += upper(A).
+	Folds a symmetric rank-k update (DSYRK, upper) of a block into a packed accumulator.
+	@param n dimension
+	@param A n x n column-major matrix (only the upper triangle is read)
+	@param lda leading dimension of A
+	@param[in,out] packed packedLength(n) entries, in the order of getArray()*/
+	static void addUpper(int n, const double A[], int lda, double packed[]);
+
+	/** Cholesky-factor the matrix
+	@return the factorization
+	@throw LapackError if the matrix is not positive definite*/
+	Cholesky cholesky() const throw (SizeError, LapackError);
+
+	private:
+	/** offset of (i,j) in packed upper storage*/
+	std::size_t index(int i, int j) const
+	{
+		if (i > j)
+		{
+			int t = i;
+			i = j;
+			j = t;
+		}
+		return (std::size_t)i + (std::size_t)j*(j+1)/2;
+	}
+
+	int dim;
+	std::vector<double> entries;
+};
+
+#endif /* SYMMETRIC_MATRIX_H */
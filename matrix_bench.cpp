@@ -0,0 +1,218 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+/*! \file matrix_bench.cpp
+*   \brief microbenchmarks of the Matrix primitives and factorizations, reported as JSON
+*
+* Usage: gaussmix_bench [min_seconds]
+*
+* Every operation is timed on square matrices from 2x2 to 512x512. Each timing repeats the operation,
+* doubling the repetition count until a run takes at least min_seconds (default 0.05), and reports
+* the mean time per operation. The output is one JSON document on stdout, e.g.
+*   {"min_seconds": 0.05, "threads": 4, "benchmarks": [
+*     {"name": "dot", "n": 64, "iterations": 4096, "ns_per_op": 21345.6}, ...]}
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif /* _OPENMP */
+
+#include "Matrix.h"
+#include "SymmetricMatrix.h"
+
+using namespace std;
+
+// results are accumulated here so the compiler cannot discard the work being timed
+static volatile double sink = 0.0;
+
+static const int SIZES[] = {2, 4, 8, 16, 32, 64, 128, 256, 512};
+static const int NUM_SIZES = sizeof(SIZES)/sizeof(SIZES[0]);
+
+// number of covariances factored together in the batch benchmark
+static const int BATCH = 8;
+
+
+/*! \brief time an operation: repeat it until a run lasts at least min_seconds
+@param op the operation
+@param min_seconds shortest run to accept
+@param[out] iterations number of repetitions in the accepted run
+@return mean nanoseconds per repetition
+*/
+template<typename Op>
+double timeOp(Op op, double min_seconds, long & iterations)
+{
+    typedef std::chrono::steady_clock clock;
+    op(); // warm up caches (and allocate any lazily created state)
+    for (iterations = 1; ; iterations *= 2)
+    {
+        clock::time_point start = clock::now();
+        for (long i = 0; i < iterations; i++)
+            op();
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if (seconds >= min_seconds || iterations >= (1L << 40))
+            return seconds * 1e9 / iterations;
+    }
+}
+
+/*! \brief fill a matrix with uniform [-1,1) entries */
+void randomFill(Matrix & A)
+{
+    for (int j = 0; j < A.colCount(); j++)
+        for (int i = 0; i < A.rowCount(); i++)
+            A.update(2.0*rand()/RAND_MAX - 1.0, i, j);
+}
+
+/*! \brief a well conditioned symmetric positive definite n x n matrix: B*B'/n + I */
+Matrix randomCovariance(int n)
+{
+    Matrix B(n,n);
+    randomFill(B);
+    Matrix S(n,n);
+    Matrix::syrk(1.0/n, B, Matrix::NO_TRANSPOSE, 0.0, S);
+    S.symmetrize();
+    for (int i = 0; i < n; i++)
+        S.update(S.getValue(i,i) + 1.0, i, i);
+    return S;
+}
+
+/*! \brief print one result as a JSON object */
+void report(const char * name, int n, long iterations, double ns, bool & first)
+{
+    printf("%s\n    {\"name\": \"%s\", \"n\": %d, \"iterations\": %ld, \"ns_per_op\": %.1f}",
+           first ? "" : ",", name, n, iterations, ns);
+    first = false;
+}
+
+int main(int argc, char *argv[])
+{
+    double min_seconds = 0.05;
+    if (argc > 1)
+        min_seconds = atof(argv[1]);
+    if (argc > 2 || min_seconds <= 0)
+    {
+        fprintf(stderr, "Usage: gaussmix_bench [min_seconds]\n");
+        return 1;
+    }
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif /* _OPENMP */
+
+    srand(12345);
+    printf("{\"min_seconds\": %g, \"threads\": %d, \"benchmarks\": [", min_seconds, threads);
+    bool first = true;
+
+    for (int s = 0; s < NUM_SIZES; s++)
+    {
+        const int n = SIZES[s];
+        long iterations;
+        double ns;
+
+        Matrix A(n,n), B(n,n);
+        randomFill(A);
+        randomFill(B);
+        Matrix S = randomCovariance(n);
+        std::vector<double> x(n), mu(n, 0.0);
+        for (int i = 0; i < n; i++)
+            x[i] = 2.0*rand()/RAND_MAX - 1.0;
+
+        // one sweep over all n*n elements
+        ns = timeOp([&]() {
+            double sum = 0.0;
+            for (int j = 0; j < n; j++)
+                for (int i = 0; i < n; i++)
+                    sum += A.getValue(i,j);
+            sink += sum;
+        }, min_seconds, iterations);
+        report("getValue", n, iterations, ns, first);
+
+        // one sweep writing all n*n elements
+        ns = timeOp([&]() {
+            for (int j = 0; j < n; j++)
+                for (int i = 0; i < n; i++)
+                    B.update(i + j, i, j);
+        }, min_seconds, iterations);
+        report("update", n, iterations, ns, first);
+
+        ns = timeOp([&]() { Matrix C = A.dot(B); sink += C.getValue(0,0); }, min_seconds, iterations);
+        report("dot", n, iterations, ns, first);
+
+        ns = timeOp([&]() { Matrix I = S.inv(); sink += I.getValue(0,0); }, min_seconds, iterations);
+        report("inv", n, iterations, ns, first);
+
+        ns = timeOp([&]() { sink += S.det(); }, min_seconds, iterations);
+        report("det", n, iterations, ns, first);
+
+        // insert a row into the middle of an (n-1) x n matrix (includes copying the matrix)
+        Matrix R(n-1, n);
+        randomFill(R);
+        ns = timeOp([&]() {
+            Matrix T = R;
+            T.insertRow(&x[0], n, n/2);
+            sink += T.getValue(0,0);
+        }, min_seconds, iterations);
+        report("insertRow", n, iterations, ns, first);
+
+        ns = timeOp([&]() { double *a = A.Serialize(); sink += a[2]; delete[] a; }, min_seconds, iterations);
+        report("Serialize", n, iterations, ns, first);
+
+        ns = timeOp([&]() { Cholesky c = S.cholesky(); sink += c.logdet(); }, min_seconds, iterations);
+        report("cholesky", n, iterations, ns, first);
+
+        Cholesky factor = S.cholesky();
+        ns = timeOp([&]() { sink += factor.mahalanobis(&x[0], &mu[0]); }, min_seconds, iterations);
+        report("cholesky_mahalanobis", n, iterations, ns, first);
+
+        // factor BATCH covariances of this size together (per batch, not per matrix)
+        std::vector<Matrix *> sigmas(BATCH, &S);
+        ns = timeOp([&]() { CholeskyBatch b(sigmas); sink += b.logdets()[0]; }, min_seconds, iterations);
+        report("cholesky_batch8", n, iterations, ns, first);
+
+        CholeskyBatch batch(sigmas);
+        ns = timeOp([&]() { sink += batch.mahalanobis(0, &x[0], &mu[0]); }, min_seconds, iterations);
+        report("batch_mahalanobis", n, iterations, ns, first);
+
+        SymmetricMatrix P(S);
+        ns = timeOp([&]() { P.spr(1e-9, &x[0]); }, min_seconds, iterations);
+        report("symmetric_spr", n, iterations, ns, first);
+
+        ns = timeOp([&]() { Cholesky c = P.cholesky(); sink += c.logdet(); }, min_seconds, iterations);
+        report("symmetric_cholesky", n, iterations, ns, first);
+    }
+
+    printf("\n]}\n");
+    return 0;
+}
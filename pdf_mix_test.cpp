@@ -0,0 +1,149 @@
+/*********************************************************************************
+# Copyright (c) 2012, CyberPoint International, LLC
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the CyberPoint International, LLC nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL CYBERPOINT INTERNATIONAL, LLC BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**********************************************************************************/
+
+
+
+
+
+/*! \file pdf_mix_test.cpp
+*   \brief checks that the mixture scoring functions reject a k that does not match the model
+*
+* Usage: gaussmix_test
+*
+* Every gaussmix_pdf_mix overload, for every CovarianceType, and gaussmix_pdf_mix_sparse are called on a
+* 3 component model with k = 1 (smaller than the model: the scorers used to write all 3 component
+* densities into a k entry buffer), k = 5 and k = 3. The first two must throw SizeError and the last must
+* return a finite log likelihood. Prints one line per failed check; exits 1 if there was any.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "GaussMix.h"
+
+using namespace std;
+
+static const int M = 2;
+static const int K = 3;
+static const int N = 4;
+
+static int failures = 0;
+
+/*! \brief call score(k) with k smaller than, larger than and equal to the model's K, and check the outcome
+@param name what is being scored, for the report
+@param score the call under test
+*/
+template<typename Score>
+void checkSizes(const char * name, Score score)
+{
+    const int bad[] = {1, K + 2};
+    for (int b = 0; b < 2; b++)
+    {
+        try
+        {
+            score(bad[b]);
+            printf("FAILED: %s accepted k = %d for a %d component model\n", name, bad[b], K);
+            failures++;
+        }
+        catch (SizeError &)
+        {
+        }
+    }
+
+    try
+    {
+        double log_likelihood = score(K);
+        if (!isfinite(log_likelihood))
+        {
+            printf("FAILED: %s gave %g with k = %d\n", name, log_likelihood, K);
+            failures++;
+        }
+    }
+    catch (std::exception & e)
+    {
+        printf("FAILED: %s threw \"%s\" with k = %d\n", name, e.what(), K);
+        failures++;
+    }
+}
+
+int main()
+{
+    const double data[N*M] = {0.1, 0.2, 1.5, -0.3, -2.0, 0.7, 0.4, 3.1};
+    const float float_data[N*M] = {0.1f, 0.2f, 1.5f, -0.3f, -2.0f, 0.7f, 0.4f, 3.1f};
+    MatrixView X(data, N, M, M);
+    FloatMatrixView float_X(float_data, N, M, M);
+    std::vector<double> point(data, data + M);
+
+    // K components with distinct means and covariances, and a k x m matrix of their diagonals
+    Matrix mu_matrix(K, M);
+    Matrix variance_matrix(K, M);
+    std::vector<Matrix*> sigma_matrix;
+    std::vector<double> Pks(K, 1.0/K);
+    for (int g = 0; g < K; g++)
+    {
+        sigma_matrix.push_back(new Matrix(M, M));
+        for (int j = 0; j < M; j++)
+        {
+            mu_matrix.update(g - 1.0 + 0.5*j, g, j);
+            variance_matrix.update(1.0 + 0.5*g, g, j);
+            sigma_matrix[g]->update(1.0 + 0.5*g, j, j);
+        }
+        sigma_matrix[g]->update(0.25, 0, 1);
+        sigma_matrix[g]->update(0.25, 1, 0);
+    }
+
+    const gaussmix::CovarianceType types[] = {gaussmix::COVARIANCE_FULL, gaussmix::COVARIANCE_DIAGONAL,
+                                              gaussmix::COVARIANCE_SPHERICAL, gaussmix::COVARIANCE_TIED};
+    for (int t = 0; t < 4; t++)
+    {
+        gaussmix::CovarianceType type = types[t];
+        std::vector<double> log_likelihoods;
+        checkSizes("gaussmix_pdf_mix(m, k, point)", [&](int k) {
+            return gaussmix::gaussmix_pdf_mix(M, k, point, sigma_matrix, mu_matrix, Pks, type); });
+        checkSizes("gaussmix_pdf_mix(view, row)", [&](int k) {
+            return gaussmix::gaussmix_pdf_mix(X, 1, k, sigma_matrix, mu_matrix, Pks, type); });
+        checkSizes("gaussmix_pdf_mix(float view, row)", [&](int k) {
+            return gaussmix::gaussmix_pdf_mix(float_X, 1, k, sigma_matrix, mu_matrix, Pks, type); });
+        checkSizes("gaussmix_pdf_mix(view)", [&](int k) {
+            return gaussmix::gaussmix_pdf_mix(X, k, sigma_matrix, mu_matrix, Pks, log_likelihoods, type); });
+        checkSizes("gaussmix_pdf_mix(float view)", [&](int k) {
+            return gaussmix::gaussmix_pdf_mix(float_X, k, sigma_matrix, mu_matrix, Pks, log_likelihoods, type); });
+    }
+
+    SparseMatrix sparse_X(M);
+    for (int i = 0; i < N; i++)
+        sparse_X.appendDenseRow(&data[i*M]);
+    checkSizes("gaussmix_pdf_mix_sparse", [&](int k) {
+        return gaussmix::gaussmix_pdf_mix_sparse(sparse_X, 1, k, variance_matrix, mu_matrix, Pks); });
+
+    for (int g = 0; g < K; g++)
+        delete sigma_matrix[g];
+
+    if (failures == 0)
+        printf("all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
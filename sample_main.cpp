@@ -35,6 +35,7 @@
 #include <vector>
 #include <iostream>
 #include "GaussMix.h"
+#include "MatrixBuilder.h"
 #include <unistd.h>
 
 #ifdef UseMPI
@@ -193,25 +194,9 @@ int main(int argc, char *argv[])
 		// now let's restrict to the -1 subpopulation, if we have labels
 		if (labels[0] != 0)  // assume 0 indicates absence of labels
 		{
-			int num_subpop = 0;
-
 			// isolate subpopulation
-			Matrix S;
-			double temp[m];
-
-			for (int i = 0; i < n; i++)
-			{
-				if (labels[i] == -1)
-				{
-					for (int j = 0; j < m; j++)
-					{
-						temp[j] = data.getValue(i,j);
-					}
-					//******************* should the n be m?
-					S.insertRow(&temp[0],m,num_subpop);
-					num_subpop++;
-				}
-			}
+			Matrix S = gatherRows(data, labels, -1);
+			int num_subpop = S.rowCount();
 
 
 			// create vectors that hold pointers to the adapted result covariance matrices